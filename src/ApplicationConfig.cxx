@@ -88,6 +88,7 @@ void ApplicationConfig::applyLogLevelOverride(const std::string &levelName) {
 
 std::ostream& ApplicationConfig::print(std::ostream &out, const std::string &format) {
 	if (format == "json") { config().toJSON(out); out << endl; }
+	else if (format == "binary") { out << PropVal::binaryFileMagic(); PropVal::writeBinaryRecord(out, config().toBinary()); }
 	else throw invalid_argument("Unknown configuration output format");
 	return out;
 }
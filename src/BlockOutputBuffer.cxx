@@ -0,0 +1,189 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "BlockOutputBuffer.h"
+
+#include <stdexcept>
+#include <chrono>
+
+#include "logging.h"
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+BlockOutputBuffer::FlushPolicy BlockOutputBuffer::flushPolicy(const std::string &name) {
+	if (name == "line") return FlushPolicy::Line;
+	else if (name == "lines") return FlushPolicy::Lines;
+	else if (name == "bytes") return FlushPolicy::Bytes;
+	else if (name == "finalize") return FlushPolicy::Finalize;
+	else throw invalid_argument("Invalid flush policy \"%s\", must be \"line\", \"lines\", \"bytes\" or \"finalize\""_format(name));
+}
+
+
+void BlockOutputBuffer::idleWait(size_t &nIdle) {
+	// Spin briefly, then back off, so an idle thread doesn't burn a core:
+	if (++nIdle < 64) this_thread::yield();
+	else this_thread::sleep_for(chrono::microseconds(100));
+}
+
+
+void BlockOutputBuffer::writeBlock(const std::string &data, bool flush) {
+	m_target->write(data.data(), streamsize(data.size()));
+	if (flush) m_target->flush();
+	if (!*m_target) throw runtime_error("Writing output block failed");
+}
+
+
+void BlockOutputBuffer::handOver(bool flush) {
+	if (flush) {
+		m_linesSinceFlush = 0;
+		m_bytesSinceFlush = 0;
+	} else {
+		m_bytesSinceFlush += m_block.size();
+	}
+
+	if (!m_writeThread.joinable()) {
+		writeBlock(m_block, flush);
+		m_block.clear();
+		return;
+	}
+
+	checkWriteError();
+
+	// Swap current block with a written one, to reuse its capacity:
+	Block block;
+	m_freeBlocks.pop(block);
+	block.data.swap(m_block);
+	block.flush = flush;
+	m_block.clear();
+
+	size_t nIdle = 0;
+	while (!m_filledBlocks.push(block)) {
+		checkWriteError();
+		idleWait(nIdle);
+	}
+}
+
+
+void BlockOutputBuffer::writeThreadLoop() {
+	try {
+		Block block;
+		size_t nIdle = 0;
+		while (true) {
+			if (m_filledBlocks.pop(block)) {
+				nIdle = 0;
+				writeBlock(block.data, block.flush);
+				block.data.clear();
+				// If the free queue is full, the block is simply dropped:
+				m_freeBlocks.push(block);
+			} else if (m_stopWrite.load(memory_order_acquire)) {
+				if (m_filledBlocks.empty()) break;
+			} else {
+				idleWait(nIdle);
+			}
+		}
+	} catch (...) {
+		m_writeError = current_exception();
+		m_writeFailed.store(true, memory_order_release);
+	}
+}
+
+
+void BlockOutputBuffer::stopWriteThread() {
+	if (!m_writeThread.joinable()) return;
+	m_stopWrite.store(true, memory_order_release);
+	m_writeThread.join();
+	m_stopWrite.store(false);
+}
+
+
+void BlockOutputBuffer::checkWriteError() {
+	if (m_writeFailed.load(memory_order_acquire)) {
+		stopWriteThread();
+		m_writeFailed.store(false);
+		exception_ptr writeError = m_writeError;
+		m_writeError = nullptr;
+		rethrow_exception(writeError);
+	}
+}
+
+
+void BlockOutputBuffer::open(std::ostream &target, FlushPolicy policy, size_t flushLines, size_t flushBytes, size_t blockSize, bool async) {
+	close();
+
+	m_target = &target;
+	m_policy = policy;
+	m_flushLines = max(flushLines, size_t(1));
+	m_flushBytes = max(flushBytes, size_t(1));
+	m_blockSize = max(blockSize, size_t(1));
+	m_block.clear();
+	m_block.reserve(m_blockSize);
+	m_linesSinceFlush = 0;
+	m_bytesSinceFlush = 0;
+	m_nLines = 0;
+
+	if (async) m_writeThread = thread(&BlockOutputBuffer::writeThreadLoop, this);
+}
+
+
+void BlockOutputBuffer::endLine() {
+	m_block.push_back('\n');
+	++m_linesSinceFlush;
+	++m_nLines;
+
+	switch (m_policy) {
+		case FlushPolicy::Line:
+			handOver(true); break;
+		case FlushPolicy::Lines:
+			if (m_linesSinceFlush >= m_flushLines) handOver(true);
+			else if (m_block.size() >= m_blockSize) handOver(false);
+			break;
+		case FlushPolicy::Bytes:
+			if (m_bytesSinceFlush + m_block.size() >= m_flushBytes) handOver(true);
+			else if (m_block.size() >= m_blockSize) handOver(false);
+			break;
+		case FlushPolicy::Finalize:
+			if (m_block.size() >= m_blockSize) handOver(false);
+			break;
+	}
+}
+
+
+void BlockOutputBuffer::close() {
+	if (m_target == nullptr) return;
+
+	// Hand over even if empty, so the target is flushed after the last block:
+	handOver(true);
+	stopWriteThread();
+	m_target = nullptr;
+	checkWriteError();
+}
+
+
+BlockOutputBuffer::~BlockOutputBuffer() {
+	try { close(); }
+	catch (const std::exception &e) {
+		dbrx_log_error("Writing remaining output failed: %s", e.what());
+	}
+}
+
+
+} // namespace dbrx
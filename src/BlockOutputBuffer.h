@@ -0,0 +1,165 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_BLOCKOUTPUTBUFFER_H
+#define DBRX_BLOCKOUTPUTBUFFER_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include <atomic>
+#include <thread>
+#include <exception>
+
+
+namespace dbrx {
+
+
+/// @brief Lock-free bounded queue for one producer and one consumer thread.
+
+template<typename T> class SPSCQueue {
+protected:
+	std::vector<T> m_slots;
+	std::atomic<size_t> m_head{0}; // Next slot to pop, written by consumer
+	std::atomic<size_t> m_tail{0}; // Next slot to push, written by producer
+
+public:
+	/// Moves x into the queue, x is left untouched if the queue is full
+	bool push(T &x) {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % m_slots.size();
+		if (next == m_head.load(std::memory_order_acquire)) return false;
+		m_slots[tail] = std::move(x);
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &x) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) return false;
+		x = std::move(m_slots[head]);
+		m_head.store((head + 1) % m_slots.size(), std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+	SPSCQueue(size_t capacity): m_slots(capacity + 1) {}
+};
+
+
+
+/// @brief Collects formatted text output in large blocks.
+///
+/// Blocks are written to the target stream according to the flush policy,
+/// either directly or by a background thread. In asynchronous mode, filled
+/// and written (reusable) blocks are passed between the threads via
+/// lock-free queues.
+
+class BlockOutputBuffer {
+public:
+	enum class FlushPolicy { Line, Lines, Bytes, Finalize };
+
+	static FlushPolicy flushPolicy(const std::string &name);
+
+protected:
+	struct Block {
+		std::string data;
+		bool flush = false;
+	};
+
+	// Appends everything written to the formatter to the current block
+	class BlockStreamBuf: public std::streambuf {
+	protected:
+		std::string &m_block;
+
+		int_type overflow(int_type c) override {
+			if (c != traits_type::eof()) m_block.push_back(char(c));
+			return c;
+		}
+
+		std::streamsize xsputn(const char* s, std::streamsize n) override {
+			m_block.append(s, size_t(n));
+			return n;
+		}
+
+	public:
+		BlockStreamBuf(std::string &block): m_block(block) {}
+	};
+
+	static const size_t s_queueSize = 8;
+
+	std::ostream* m_target = nullptr;
+
+	std::string m_block;
+	BlockStreamBuf m_blockStreamBuf{m_block};
+	std::ostream m_formatter{&m_blockStreamBuf};
+
+	FlushPolicy m_policy = FlushPolicy::Line;
+	size_t m_flushLines = 0;
+	size_t m_flushBytes = 0;
+	size_t m_blockSize = 0;
+	size_t m_linesSinceFlush = 0;
+	size_t m_bytesSinceFlush = 0; // Handed over without flush, not counting m_block
+	size_t m_nLines = 0;
+
+	SPSCQueue<Block> m_filledBlocks{s_queueSize};
+	SPSCQueue<Block> m_freeBlocks{s_queueSize};
+	std::thread m_writeThread;
+	std::atomic<bool> m_stopWrite{false};
+	std::atomic<bool> m_writeFailed{false};
+	std::exception_ptr m_writeError;
+
+	static void idleWait(size_t &nIdle);
+
+	virtual void writeBlock(const std::string &data, bool flush);
+	virtual void handOver(bool flush);
+	virtual void writeThreadLoop();
+	virtual void stopWriteThread();
+	virtual void checkWriteError();
+
+public:
+	/// Formatting stream for the current line
+	std::ostream& formatter() { return m_formatter; }
+
+	/// Appends to the current line directly, bypassing the formatter
+	std::string& block() { return m_block; }
+
+	/// Number of lines since open
+	size_t nLines() const { return m_nLines; }
+
+	virtual void open(std::ostream &target, FlushPolicy policy, size_t flushLines, size_t flushBytes, size_t blockSize, bool async);
+
+	/// Terminates the current line and writes output according to policy
+	virtual void endLine();
+
+	/// Writes all remaining output and flushes the target
+	virtual void close();
+
+	BlockOutputBuffer& operator=(const BlockOutputBuffer &other) = delete;
+
+	BlockOutputBuffer() {}
+	BlockOutputBuffer(const BlockOutputBuffer &other) = delete;
+
+	virtual ~BlockOutputBuffer();
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_BLOCKOUTPUTBUFFER_H
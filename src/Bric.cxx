@@ -34,7 +34,9 @@ namespace dbrx {
 
 
 PropPath BricComponent::absolutePath() const {
-	return hasParent() ? parent().absolutePath() % name() : name();
+	const PropPath* memoized = memoizedAbsolutePath();
+	if (memoized != nullptr) return *memoized;
+	else return hasParent() ? parent().absolutePath() % name() : name();
 }
 
 
@@ -552,12 +554,21 @@ void Bric::addDynInput(std::unique_ptr<Bric::InputTerminal> terminal) {
 void Bric::initBricHierarchy() {
 	if (hasParent()) throw invalid_argument("Can't init bric hierarchy starting from bric \"%s\", not a top bric"_format(absolutePath()));
 
+	memoizeAbsolutePaths(false);
 	disconnectInputs();
 	connectInputs();
+	memoizeAbsolutePaths(true);
 	initRecursive();
 }
 
 
+void Bric::memoizeAbsolutePaths(bool enable) {
+	memoizeAbsolutePath(enable);
+	for (auto &entry: m_terminals) entry.second->memoizeAbsolutePath(enable);
+	for (auto &entry: m_brics) entry.second->memoizeAbsolutePaths(enable);
+}
+
+
 std::ostream & Bric::printInfo(std::ostream &os) const {
 	os << "Bric " << name() << ":" << endl;
 
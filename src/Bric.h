@@ -47,6 +47,11 @@ protected:
 
 	virtual void setParent(Bric *parentBric) = 0;
 
+	// Absolute path memoized by Bric::memoizeAbsolutePaths (nullptr if not
+	// memoized):
+	virtual const PropPath* memoizedAbsolutePath() const = 0;
+	virtual void memoizeAbsolutePath(bool enable) = 0;
+
 public:
 	class BCReference final: public virtual Printable {
 	protected:
@@ -110,13 +115,24 @@ protected:
 
 	std::string m_title;
 
+	PropPath m_absolutePath;
+	bool m_absolutePathMemoized = false;
+
 	void setParent(Bric *parentBric) final override;
 
+	const PropPath* memoizedAbsolutePath() const final override
+		{ return m_absolutePathMemoized ? &m_absolutePath : nullptr; }
+
+	void memoizeAbsolutePath(bool enable) final override;
+
+	// Forget memoized paths of this component and everything inside it:
+	void forgetAbsolutePaths();
+
 public:
 	PropKey name() const final override { return m_key; }
 
 	void setName(PropKey componentName) final override {
-		if (!hasParent()) m_key = componentName;
+		if (!hasParent()) { forgetAbsolutePaths(); m_key = componentName; }
 		else throw std::logic_error("Can't change name for component \"%s\" because it already has a parent"_format(absolutePath()));
 	}
 
@@ -158,6 +174,9 @@ public:
 
 		virtual InputTerminal* createMatchingDynInput(Bric* inputBric,
 			PropKey inputName, std::string inputTitle = "") = 0;
+
+		// Creates a new default-valued value of the same type as this terminal
+		virtual std::unique_ptr<PrimaryValue> createMatchingValue() const = 0;
 	};
 
 
@@ -272,6 +291,9 @@ public:
 
 		InputTerminal* createMatchingDynInput(Bric* inputBric,
 			PropKey inputName, std::string inputTitle = "") override;
+
+		std::unique_ptr<PrimaryValue> createMatchingValue() const override
+			{ return std::unique_ptr<PrimaryValue>(new TypedPrimaryValue<T>()); }
 	};
 
 	template <typename T> class TypedOutputTerminal
@@ -414,6 +436,11 @@ public:
 	// called on top brics (brics without a parent).
 	virtual void initBricHierarchy() final;
 
+	// Memoize (or forget) the absolute paths of this bric and all components
+	// inside it, done by initBricHierarchy once the hierarchy is complete.
+	// Changing the parent of a component forgets the paths inside it.
+	virtual void memoizeAbsolutePaths(bool enable) final;
+
 	// User overload, executed, undefined if executed before or after sub-bric
 	// init (possibly in parallel?):
 	virtual void init() {};
@@ -612,7 +639,24 @@ inline size_t BricComponent::hierarchyLevel() const
 
 
 
+inline void BricComponentImpl::memoizeAbsolutePath(bool enable) {
+	m_absolutePathMemoized = false;
+	m_absolutePath = enable ? absolutePath() : PropPath();
+	m_absolutePathMemoized = enable;
+}
+
+
+inline void BricComponentImpl::forgetAbsolutePaths() {
+	if (m_absolutePathMemoized) {
+		Bric *bric = dynamic_cast<Bric*>(this);
+		if (bric != nullptr) bric->memoizeAbsolutePaths(false);
+		else memoizeAbsolutePath(false);
+	}
+}
+
+
 inline void BricComponentImpl::setParent(Bric *parentBric) {
+	if (parentBric != nullptr) forgetAbsolutePaths();
 	if (m_parent != nullptr) m_parent->unregisterComponent(this);
 	if (parentBric != nullptr) {
 		m_parent = parentBric;
@@ -683,8 +727,8 @@ public:
 	{
 	protected:
 		PropPath m_source;
-		const Bric* m_effSrcBric;
-		const Terminal *m_srcTerminal;
+		const Bric* m_effSrcBric = nullptr;
+		const Terminal *m_srcTerminal = nullptr;
 		TypedPrimaryValue<T> m_fixedValue;
 
 		virtual void setSrcTerminal(const Terminal* terminal) final { m_srcTerminal = terminal; }
@@ -699,6 +743,7 @@ public:
 				m_source = BCReference(config).path();
 			} else {
 				dbrx_log_trace("Assigning fixed value %s to input %s"_format(config, absolutePath()));
+				m_source = PropPath();
 				m_fixedValue.setToDefault();
 				m_fixedValue.fromPropVal(config);
 				value().referTo(m_fixedValue);
@@ -710,7 +755,7 @@ public:
 			else return PropVal(BCReference(source()));
 		}
 
-		bool hasFixedValue() const override { return value().isReferringTo(m_fixedValue); }
+		bool hasFixedValue() const override { return m_source.empty() && value().isReferringTo(m_fixedValue); }
 
 		const PropPath& source() const final override { return m_source; }
 
@@ -727,6 +772,14 @@ public:
 			setParent(parentBric);
 		}
 
+		// Input with a fixed default value, used unless configured otherwise:
+		template<typename U> Input(BricWithInputs *parentBric, PropKey inputName,
+			std::string inputTitle, U&& defaultValue) : Input(parentBric, inputName, inputTitle)
+		{
+			m_fixedValue = std::forward<U>(defaultValue);
+			value().referTo(m_fixedValue);
+		}
+
 		~Input() override { setParent(nullptr); }
 	};
 
@@ -0,0 +1,303 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_FLATMAP_H
+#define DBRX_FLATMAP_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <iterator>
+#include <cmath>
+#include <cstddef>
+
+
+namespace dbrx {
+
+
+/// @brief Associative container with std::map interface, stored as sorted
+/// vectors of key/value pairs.
+///
+/// Entries live in a main vector and a small insert buffer, both sorted by
+/// key (iterators merge the two on the fly). Lookup is a binary search over
+/// contiguous memory, iteration is a linear scan, and there's no allocation
+/// per entry. Keys inserted in ascending order are appended to the main
+/// vector directly, other new keys go into the insert buffer, which is
+/// merged into the main vector when it grows beyond about sqrt(size()).
+/// Unlike std::map, insertion and erasure invalidate iterators and
+/// references to entries. Iterators are forward iterators.
+
+template<typename K, typename V, typename Compare = std::less<K>> class FlatMap {
+public:
+	using key_type = K;
+	using mapped_type = V;
+	using value_type = std::pair<K, V>;
+	using key_compare = Compare;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+
+protected:
+	using Storage = std::vector<value_type>;
+
+	Storage m_main;
+	Storage m_buffer;
+
+	static bool keyLess(const K &a, const K &b) { return Compare()(a, b); }
+	static bool entryLess(const value_type &a, const value_type &b) { return keyLess(a.first, b.first); }
+	static bool entryLessKey(const value_type &a, const K &b) { return keyLess(a.first, b); }
+	static bool keyLessEntry(const K &a, const value_type &b) { return keyLess(a, b.first); }
+	static bool sameKey(const value_type &a, const value_type &b) { return !keyLess(a.first, b.first) && !keyLess(b.first, a.first); }
+
+	template<typename Ptr, typename Ref> class IteratorImpl {
+	protected:
+		friend class FlatMap;
+
+		Ptr m_a = nullptr, m_aEnd = nullptr;
+		Ptr m_b = nullptr, m_bEnd = nullptr;
+
+		bool inMain() const { return (m_b == m_bEnd) || ((m_a != m_aEnd) && keyLess(m_a->first, m_b->first)); }
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = typename FlatMap::value_type;
+		using difference_type = ptrdiff_t;
+		using pointer = Ptr;
+		using reference = Ref;
+
+		Ref operator*() const { return inMain() ? *m_a : *m_b; }
+		Ptr operator->() const { return inMain() ? m_a : m_b; }
+
+		IteratorImpl& operator++() { if (inMain()) ++m_a; else ++m_b; return *this; }
+		IteratorImpl operator++(int) { IteratorImpl tmp(*this); operator++(); return tmp; }
+
+		friend bool operator==(const IteratorImpl &x, const IteratorImpl &y) { return (x.m_a == y.m_a) && (x.m_b == y.m_b); }
+		friend bool operator!=(const IteratorImpl &x, const IteratorImpl &y) { return ! operator==(x, y); }
+
+		operator IteratorImpl<const typename FlatMap::value_type*, const typename FlatMap::value_type&>() const
+			{ return {m_a, m_aEnd, m_b, m_bEnd}; }
+
+		IteratorImpl() {}
+		IteratorImpl(Ptr a, Ptr aEnd, Ptr b, Ptr bEnd): m_a(a), m_aEnd(aEnd), m_b(b), m_bEnd(bEnd) {}
+	};
+
+public:
+	using iterator = IteratorImpl<value_type*, value_type&>;
+	using const_iterator = IteratorImpl<const value_type*, const value_type&>;
+
+protected:
+	iterator iterAt(size_t mainIdx, size_t bufferIdx) {
+		value_type *a = m_main.data(), *b = m_buffer.data();
+		return iterator(a + mainIdx, a + m_main.size(), b + bufferIdx, b + m_buffer.size());
+	}
+
+	const_iterator iterAt(size_t mainIdx, size_t bufferIdx) const {
+		const value_type *a = m_main.data(), *b = m_buffer.data();
+		return const_iterator(a + mainIdx, a + m_main.size(), b + bufferIdx, b + m_buffer.size());
+	}
+
+	size_t mainLowerBound(const K &key) const {
+		// Fast path for lookup and insertion in key order:
+		if (m_main.empty() || keyLess(m_main.back().first, key)) return m_main.size();
+		return std::lower_bound(m_main.begin(), m_main.end(), key, entryLessKey) - m_main.begin();
+	}
+
+	size_t bufferLowerBound(const K &key) const {
+		return std::lower_bound(m_buffer.begin(), m_buffer.end(), key, entryLessKey) - m_buffer.begin();
+	}
+
+	// Returns pointer to entry with given key, or nullptr
+	const value_type* findEntry(const K &key) const {
+		size_t i = mainLowerBound(key);
+		if ((i < m_main.size()) && !keyLess(key, m_main[i].first)) return &m_main[i];
+		size_t j = bufferLowerBound(key);
+		if ((j < m_buffer.size()) && !keyLess(key, m_buffer[j].first)) return &m_buffer[j];
+		return nullptr;
+	}
+
+	value_type* findEntry(const K &key)
+		{ return const_cast<value_type*>(static_cast<const FlatMap*>(this)->findEntry(key)); }
+
+	size_t maxBufferSize() const { return 16 + size_t(std::sqrt(double(m_main.size()))); }
+
+	void mergeBuffer() {
+		if (m_buffer.empty()) return;
+		size_t nMain = m_main.size();
+		m_main.insert(m_main.end(), std::make_move_iterator(m_buffer.begin()), std::make_move_iterator(m_buffer.end()));
+		m_buffer.clear();
+		std::inplace_merge(m_main.begin(), m_main.begin() + nMain, m_main.end(), entryLess);
+	}
+
+	// Key must not be present yet
+	value_type& insertNew(value_type value) {
+		if (m_buffer.empty() && (m_main.empty() || keyLess(m_main.back().first, value.first))) {
+			m_main.push_back(std::move(value));
+			return m_main.back();
+		}
+
+		auto pos = m_buffer.insert(m_buffer.begin() + bufferLowerBound(value.first), std::move(value));
+		if (m_buffer.size() <= maxBufferSize()) return *pos;
+
+		K key = pos->first;
+		mergeBuffer();
+		return m_main[mainLowerBound(key)];
+	}
+
+	iterator toIterator(const value_type *entry) {
+		if (entry == nullptr) return end();
+		size_t i = mainLowerBound(entry->first), j = bufferLowerBound(entry->first);
+		return iterAt(i, j);
+	}
+
+public:
+	key_compare key_comp() const { return Compare(); }
+
+	iterator begin() noexcept { return iterAt(0, 0); }
+	const_iterator begin() const noexcept { return iterAt(0, 0); }
+	const_iterator cbegin() const noexcept { return iterAt(0, 0); }
+	iterator end() noexcept { return iterAt(m_main.size(), m_buffer.size()); }
+	const_iterator end() const noexcept { return iterAt(m_main.size(), m_buffer.size()); }
+	const_iterator cend() const noexcept { return iterAt(m_main.size(), m_buffer.size()); }
+
+	bool empty() const noexcept { return m_main.empty() && m_buffer.empty(); }
+	size_type size() const noexcept { return m_main.size() + m_buffer.size(); }
+
+	void reserve(size_type n) { m_main.reserve(n); }
+
+	/// Merges the insert buffer and releases unused capacity
+	void shrink_to_fit() { mergeBuffer(); m_main.shrink_to_fit(); m_buffer.shrink_to_fit(); }
+
+	void clear() noexcept { m_main.clear(); m_buffer.clear(); }
+
+	void swap(FlatMap &other) noexcept { m_main.swap(other.m_main); m_buffer.swap(other.m_buffer); }
+	friend void swap(FlatMap &a, FlatMap &b) noexcept { a.swap(b); }
+
+
+	iterator lower_bound(const K &key) { return iterAt(mainLowerBound(key), bufferLowerBound(key)); }
+	const_iterator lower_bound(const K &key) const { return iterAt(mainLowerBound(key), bufferLowerBound(key)); }
+
+	iterator upper_bound(const K &key) {
+		return iterAt(
+			std::upper_bound(m_main.begin(), m_main.end(), key, keyLessEntry) - m_main.begin(),
+			std::upper_bound(m_buffer.begin(), m_buffer.end(), key, keyLessEntry) - m_buffer.begin()
+		);
+	}
+
+	const_iterator upper_bound(const K &key) const { return const_cast<FlatMap*>(this)->upper_bound(key); }
+
+	iterator find(const K &key) {
+		size_t i = mainLowerBound(key), j = bufferLowerBound(key);
+		bool found =
+			((i < m_main.size()) && !keyLess(key, m_main[i].first)) ||
+			((j < m_buffer.size()) && !keyLess(key, m_buffer[j].first));
+		return found ? iterAt(i, j) : end();
+	}
+
+	const_iterator find(const K &key) const { return const_cast<FlatMap*>(this)->find(key); }
+
+	size_type count(const K &key) const { return (findEntry(key) != nullptr) ? 1 : 0; }
+
+	V& at(const K &key) {
+		value_type *entry = findEntry(key);
+		if (entry == nullptr) throw std::out_of_range("FlatMap::at: key not found");
+		return entry->second;
+	}
+
+	const V& at(const K &key) const { return const_cast<FlatMap*>(this)->at(key); }
+
+
+	std::pair<iterator, bool> insert(value_type value) {
+		value_type *entry = findEntry(value.first);
+		if (entry != nullptr) return std::pair<iterator, bool>(toIterator(entry), false);
+		return std::pair<iterator, bool>(toIterator(&insertNew(std::move(value))), true);
+	}
+
+	iterator insert(const_iterator hint, value_type value) { return insert(std::move(value)).first; }
+
+	/// Appends, then sorts and merges the new entries in one pass. Like
+	/// std::map, keys already present are not overwritten.
+	template<typename InputIterator> void insert(InputIterator first, InputIterator last) {
+		mergeBuffer();
+		size_t nOld = m_main.size();
+		for (; first != last; ++first) m_main.emplace_back(*first);
+		std::stable_sort(m_main.begin() + nOld, m_main.end(), entryLess);
+		std::inplace_merge(m_main.begin(), m_main.begin() + nOld, m_main.end(), entryLess);
+		m_main.erase(std::unique(m_main.begin(), m_main.end(), sameKey), m_main.end());
+	}
+
+	void insert(std::initializer_list<value_type> init) { insert(init.begin(), init.end()); }
+
+	template<typename... Args> std::pair<iterator, bool> emplace(Args&&... args)
+		{ return insert(value_type(std::forward<Args>(args)...)); }
+
+	template<typename... Args> iterator emplace_hint(const_iterator hint, Args&&... args)
+		{ return insert(value_type(std::forward<Args>(args)...)).first; }
+
+
+	V& operator[](const K &key) {
+		value_type *entry = findEntry(key);
+		return (entry != nullptr) ? entry->second : insertNew(value_type(key, V())).second;
+	}
+
+	V& operator[](K &&key) {
+		value_type *entry = findEntry(key);
+		return (entry != nullptr) ? entry->second : insertNew(value_type(std::move(key), V())).second;
+	}
+
+
+	iterator erase(const_iterator pos) {
+		size_t i = pos.m_a - m_main.data(), j = pos.m_b - m_buffer.data();
+		if (pos.inMain()) m_main.erase(m_main.begin() + i);
+		else m_buffer.erase(m_buffer.begin() + j);
+		return iterAt(i, j);
+	}
+
+	iterator erase(const_iterator first, const_iterator last) {
+		size_t n = 0;
+		for (auto p = first; p != last; ++p) ++n;
+		iterator result = iterAt(first.m_a - m_main.data(), first.m_b - m_buffer.data());
+		for (size_t k = 0; k < n; ++k) result = erase(result);
+		return result;
+	}
+
+	size_type erase(const K &key) {
+		auto found = find(key);
+		if (found == end()) return 0;
+		erase(found);
+		return 1;
+	}
+
+
+	FlatMap& operator=(std::initializer_list<std::pair<const K, V>> init) {
+		clear();
+		insert(init.begin(), init.end());
+		return *this;
+	}
+
+	FlatMap() {}
+
+	FlatMap(std::initializer_list<std::pair<const K, V>> init) { insert(init.begin(), init.end()); }
+
+	template<typename InputIterator> FlatMap(InputIterator first, InputIterator last) { insert(first, last); }
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_FLATMAP_H
@@ -0,0 +1,112 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "format.h"
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+void MappedFile::advise(Advice advice, size_t offset, size_t length) {
+	if ((m_data == nullptr) || (offset >= m_size)) return;
+
+	// madvise requires a page-aligned start address:
+	size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+	size_t alignedOffset = offset - offset % pageSize;
+	length = min(length + (offset - alignedOffset), m_size - alignedOffset);
+
+	int posixAdvice = MADV_NORMAL;
+	switch (advice) {
+		case Advice::Sequential: posixAdvice = MADV_SEQUENTIAL; break;
+		case Advice::Random: posixAdvice = MADV_RANDOM; break;
+		case Advice::WillNeed: posixAdvice = MADV_WILLNEED; break;
+		case Advice::DontNeed: posixAdvice = MADV_DONTNEED; break;
+	}
+	// Advice is only a hint, failure is not an error:
+	madvise(m_data + alignedOffset, length, posixAdvice);
+}
+
+
+bool MappedFile::isMappable(const std::string& fileName) {
+	struct stat fileStat;
+	return (stat(fileName.c_str(), &fileStat) == 0) && S_ISREG(fileStat.st_mode);
+}
+
+
+void MappedFile::open(const std::string& fileName) {
+	close();
+
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) throw runtime_error("Can't open file \"%s\": %s"_format(fileName, strerror(errno)));
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0) {
+		int err = errno;
+		::close(fd);
+		throw runtime_error("Can't determine size of file \"%s\": %s"_format(fileName, strerror(err)));
+	}
+	if (!S_ISREG(fileStat.st_mode)) {
+		::close(fd);
+		throw runtime_error("Can't map \"%s\" into memory, not a regular file"_format(fileName));
+	}
+
+	size_t fileSize = size_t(fileStat.st_size);
+	if (fileSize > 0) {
+		void *mapped = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			int err = errno;
+			::close(fd);
+			throw runtime_error("Can't map file \"%s\" into memory: %s"_format(fileName, strerror(err)));
+		}
+		m_data = static_cast<char*>(mapped);
+	}
+	// Mapping stays valid after the file descriptor is closed:
+	::close(fd);
+
+	m_fileName = fileName;
+	m_size = fileSize;
+}
+
+
+void MappedFile::close() {
+	if (m_data != nullptr) munmap(m_data, m_size);
+	m_data = nullptr;
+	m_size = 0;
+	m_fileName.clear();
+}
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+
+} // namespace dbrx
@@ -0,0 +1,78 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_MAPPEDFILE_H
+#define DBRX_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+
+namespace dbrx {
+
+
+/// @brief Read-only memory mapping of a whole file.
+///
+/// Pages are mapped private and writable, so code that receives pointers
+/// into the mapping can't modify the file (writes go to copy-on-write
+/// pages).
+
+class MappedFile {
+protected:
+	std::string m_fileName;
+	char* m_data = nullptr;
+	size_t m_size = 0;
+
+public:
+	enum class Advice { Sequential, Random, WillNeed, DontNeed };
+
+	const std::string& fileName() const { return m_fileName; }
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	/// Writable access, e.g. for in-situ parsing (changes are never written
+	/// back to the file).
+	char* data() { return m_data; }
+
+	bool isOpen() const { return !m_fileName.empty(); }
+
+	/// Only regular files can be mapped (not stdin, pipes or devices)
+	static bool isMappable(const std::string& fileName);
+
+	virtual void open(const std::string& fileName);
+	virtual void close();
+
+	/// Access pattern hint for the given range (a hint only, never fails).
+	/// DontNeed allows the kernel to drop pages that won't be read again.
+	virtual void advise(Advice advice, size_t offset, size_t length);
+
+	virtual void advise(Advice advice) { advise(advice, 0, m_size); }
+
+	MappedFile& operator=(const MappedFile &other) = delete;
+
+	MappedFile() = default;
+	MappedFile(const MappedFile &other) = delete;
+	MappedFile(const std::string& fileName) { open(fileName); }
+
+	virtual ~MappedFile();
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_MAPPEDFILE_H
@@ -0,0 +1,331 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "NumberFormat.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+namespace {
+
+// Grisu2, see F. Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers", PLDI 2010. Produces the shortest output in the
+// vast majority of cases, the output always reads back to the same value.
+
+struct DiyFp {
+	uint64_t f;
+	int e;
+
+	DiyFp(uint64_t fp, int exp): f(fp), e(exp) {}
+
+	DiyFp operator-(const DiyFp &other) const { return DiyFp(f - other.f, e); }
+
+	// Upper 64 bits of the 128 bit product, rounded
+	DiyFp operator*(const DiyFp &other) const {
+		const uint64_t m32 = 0xFFFFFFFFULL;
+		const uint64_t a = f >> 32, b = f & m32, c = other.f >> 32, d = other.f & m32;
+		const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+		uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+		tmp += 1ULL << 31;
+		return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + other.e + 64);
+	}
+
+	DiyFp normalize() const {
+		DiyFp result = *this;
+		while (!(result.f & 0xFFC0000000000000ULL)) { result.f <<= 10; result.e -= 10; }
+		while (!(result.f & 0x8000000000000000ULL)) { result.f <<= 1; --result.e; }
+		return result;
+	}
+};
+
+
+// Exact significand and exponent of x > 0, hiddenBit is set in the
+// significand of normal numbers:
+
+DiyFp decompose(double x, uint64_t &hiddenBit) {
+	uint64_t u;
+	memcpy(&u, &x, sizeof(u));
+	int biasedE = int((u >> 52) & 0x7FF);
+	uint64_t significand = u & 0x000FFFFFFFFFFFFFULL;
+	hiddenBit = 0x0010000000000000ULL;
+	if (biasedE != 0) return DiyFp(significand + hiddenBit, biasedE - 1075);
+	else return DiyFp(significand, -1074);
+}
+
+
+DiyFp decompose(float x, uint64_t &hiddenBit) {
+	uint32_t u;
+	memcpy(&u, &x, sizeof(u));
+	int biasedE = int((u >> 23) & 0xFF);
+	uint64_t significand = u & 0x007FFFFFU;
+	hiddenBit = 0x00800000U;
+	if (biasedE != 0) return DiyFp(significand + hiddenBit, biasedE - 150);
+	else return DiyFp(significand, -149);
+}
+
+
+// Normalized 64 bit approximations of 10^-348, 10^-340, ..., 10^340
+const uint64_t cachedPowersF[] = {
+	0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76, 0xcf42894a5dce35ea,
+	0x9a6bb0aa55653b2d, 0xe61acf033d1a45df, 0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f,
+	0xbe5691ef416bd60c, 0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+	0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57, 0xc21094364dfb5637,
+	0x9096ea6f3848984f, 0xd77485cb25823ac7, 0xa086cfcd97bf97f4, 0xef340a98172aace5,
+	0xb23867fb2a35b28e, 0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+	0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126, 0xb5b5ada8aaff80b8,
+	0x87625f056c7c4a8b, 0xc9bcff6034c13053, 0x964e858c91ba2655, 0xdff9772470297ebd,
+	0xa6dfbd9fb8e5b88f, 0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+	0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06, 0xaa242499697392d3,
+	0xfd87b5f28300ca0e, 0xbce5086492111aeb, 0x8cbccc096f5088cc, 0xd1b71758e219652c,
+	0x9c40000000000000, 0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+	0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068, 0x9f4f2726179a2245,
+	0xed63a231d4c4fb27, 0xb0de65388cc8ada8, 0x83c7088e1aab65db, 0xc45d1df942711d9a,
+	0x924d692ca61be758, 0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+	0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d, 0x952ab45cfa97a0b3,
+	0xde469fbd99a05fe3, 0xa59bc234db398c25, 0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece,
+	0x88fcf317f22241e2, 0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+	0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410, 0x8bab8eefb6409c1a,
+	0xd01fef10a657842c, 0x9b10a4e5e9913129, 0xe7109bfba19c0c9d, 0xac2820d9623bf429,
+	0x80444b5e7aa7cf85, 0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+	0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b
+};
+
+const int16_t cachedPowersE[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066
+};
+
+
+// Power of ten c with c * 2^e in the Grisu2 target range, c = 10^-k
+DiyFp cachedPower(int e, int &k) {
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = int(dk);
+	if (dk - ik > 0.0) ++ik;
+	unsigned index = unsigned((ik >> 3) + 1);
+	k = -(-348 + int(index << 3));
+	return DiyFp(cachedPowersF[index], cachedPowersE[index]);
+}
+
+
+const uint64_t pow10u64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+
+int countDecimalDigits(uint32_t n) {
+	int digits = 1;
+	while ((digits < 10) && (n >= pow10u64[digits])) ++digits;
+	return digits;
+}
+
+
+void grisuRound(char* buffer, int length, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t wpW) {
+	while ((rest < wpW) && (delta - rest >= tenKappa) &&
+		((rest + tenKappa < wpW) || (wpW - rest > rest + tenKappa - wpW)))
+	{
+		--buffer[length - 1];
+		rest += tenKappa;
+	}
+}
+
+
+void digitGen(const DiyFp &w, const DiyFp &mp, uint64_t delta, char* buffer, int &length, int &k) {
+	const DiyFp one(uint64_t(1) << -mp.e, mp.e);
+	const DiyFp wpW = mp - w;
+	uint32_t p1 = uint32_t(mp.f >> -one.e);
+	uint64_t p2 = mp.f & (one.f - 1);
+	int kappa = countDecimalDigits(p1);
+	length = 0;
+
+	while (kappa > 0) {
+		uint32_t d = p1 / uint32_t(pow10u64[kappa - 1]);
+		p1 %= uint32_t(pow10u64[kappa - 1]);
+		if (d || length) buffer[length++] = char('0' + d);
+		--kappa;
+		uint64_t tmp = (uint64_t(p1) << -one.e) + p2;
+		if (tmp <= delta) {
+			k += kappa;
+			grisuRound(buffer, length, delta, tmp, pow10u64[kappa] << -one.e, wpW.f);
+			return;
+		}
+	}
+
+	while (true) {
+		p2 *= 10;
+		delta *= 10;
+		char d = char(p2 >> -one.e);
+		if (d || length) buffer[length++] = char('0' + d);
+		p2 &= one.f - 1;
+		--kappa;
+		if (p2 < delta) {
+			k += kappa;
+			int index = -kappa;
+			grisuRound(buffer, length, delta, p2, one.f, wpW.f * (index < 20 ? pow10u64[index] : 0));
+			return;
+		}
+	}
+}
+
+
+// Decimal digits of x > 0, x = digits * 10^k
+template<typename T> void grisu2(T x, char* digits, int &length, int &k) {
+	uint64_t hiddenBit = 0;
+	const DiyFp v = decompose(x, hiddenBit);
+
+	// Boundaries of the interval of values that round to x:
+	const DiyFp wPlus = DiyFp((v.f << 1) + 1, v.e - 1).normalize();
+	DiyFp wMinus = (v.f == hiddenBit) ? DiyFp((v.f << 2) - 1, v.e - 2) : DiyFp((v.f << 1) - 1, v.e - 1);
+	wMinus.f <<= wMinus.e - wPlus.e;
+	wMinus.e = wPlus.e;
+
+	const DiyFp cMk = cachedPower(wPlus.e, k);
+	const DiyFp w = v.normalize() * cMk;
+	DiyFp wp = wPlus * cMk;
+	DiyFp wm = wMinus * cMk;
+	++wm.f;
+	--wp.f;
+	digitGen(w, wp, wp.f - wm.f, digits, length, k);
+}
+
+
+size_t writeExponent(char* buffer, int exp) {
+	char* p = buffer;
+	*p++ = 'e';
+	if (exp < 0) { *p++ = '-'; exp = -exp; }
+	else *p++ = '+';
+	if (exp >= 100) { *p++ = char('0' + exp / 100); exp %= 100; }
+	*p++ = char('0' + exp / 10);
+	*p++ = char('0' + exp % 10);
+	return size_t(p - buffer);
+}
+
+
+// Uses fixed notation for decimal exponents in [-4, fixedLimit), like
+// printf "%g" with precision fixedLimit
+template<typename T> size_t formatRealImpl(char* buffer, T x, int fixedLimit) {
+	char* p = buffer;
+
+	if (x != x) { memcpy(p, "nan", 3); return 3; }
+	if (std::signbit(x)) { *p++ = '-'; x = -x; }
+	if (x == 0) { *p++ = '0'; return size_t(p - buffer); }
+	if (x > std::numeric_limits<T>::max()) { memcpy(p, "inf", 3); return size_t(p - buffer) + 3; }
+
+	char digits[20];
+	int length = 0, k = 0;
+	grisu2(x, digits, length, k);
+
+	// Decimal exponent of the first digit:
+	const int exp = length + k - 1;
+
+	if ((exp < -4) || (exp >= fixedLimit)) {
+		*p++ = digits[0];
+		if (length > 1) {
+			*p++ = '.';
+			memcpy(p, digits + 1, size_t(length - 1));
+			p += length - 1;
+		}
+		p += writeExponent(p, exp);
+	} else if (exp < 0) {
+		*p++ = '0';
+		*p++ = '.';
+		for (int i = exp + 1; i < 0; ++i) *p++ = '0';
+		memcpy(p, digits, size_t(length));
+		p += length;
+	} else if (exp >= length - 1) {
+		memcpy(p, digits, size_t(length));
+		p += length;
+		for (int i = length - 1; i < exp; ++i) *p++ = '0';
+	} else {
+		memcpy(p, digits, size_t(exp + 1));
+		p += exp + 1;
+		*p++ = '.';
+		memcpy(p, digits + exp + 1, size_t(length - exp - 1));
+		p += length - exp - 1;
+	}
+
+	return size_t(p - buffer);
+}
+
+
+const char digitPairs[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+} // namespace
+
+
+size_t NumberFormat::formatReal(char* buffer, double x) {
+	return formatRealImpl(buffer, x, 16);
+}
+
+
+size_t NumberFormat::formatReal(char* buffer, float x) {
+	return formatRealImpl(buffer, x, 9);
+}
+
+
+size_t NumberFormat::formatInteger(char* buffer, uint64_t x) {
+	// Two digits per division, written back to front:
+	char tmp[maxIntegerLength];
+	char* end = tmp + sizeof(tmp);
+	char* p = end;
+	while (x >= 100) {
+		const size_t i = size_t(x % 100) * 2;
+		x /= 100;
+		p -= 2;
+		memcpy(p, digitPairs + i, 2);
+	}
+	if (x >= 10) { p -= 2; memcpy(p, digitPairs + size_t(x) * 2, 2); }
+	else *--p = char('0' + x);
+
+	const size_t n = size_t(end - p);
+	memcpy(buffer, p, n);
+	return n;
+}
+
+
+size_t NumberFormat::formatInteger(char* buffer, int64_t x) {
+	if (x < 0) {
+		*buffer = '-';
+		return 1 + formatInteger(buffer + 1, uint64_t(0) - uint64_t(x));
+	}
+	else return formatInteger(buffer, uint64_t(x));
+}
+
+
+} // namespace dbrx
@@ -0,0 +1,102 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_NUMBERFORMAT_H
+#define DBRX_NUMBERFORMAT_H
+
+#include <string>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace dbrx {
+
+
+/// @brief Fast, locale-independent conversion of numbers to text.
+///
+/// Reals are written with the shortest digit sequence that reads back
+/// to the same value (Grisu2 algorithm), in the style of printf "%g":
+/// "0.1", "5", "-2.5e-07", "1e+300". Integers are converted two digits at
+/// a time. The result doesn't depend on the locale or on stream state, so
+/// output is reproducible.
+
+class NumberFormat {
+public:
+	/// Max. number of characters written by formatReal
+	static constexpr size_t maxRealLength = 32;
+
+	/// Max. number of characters written by formatInteger
+	static constexpr size_t maxIntegerLength = 24;
+
+	/// Writes x to buffer (not null-terminated), returns the number of
+	/// characters written. NaN is written as "nan", infinity as "inf".
+	/// Fixed notation is used for decimal exponents from -4 to 15.
+	static size_t formatReal(char* buffer, double x);
+
+	/// Shortest representation as float, fixed notation for decimal
+	/// exponents from -4 to 8.
+	static size_t formatReal(char* buffer, float x);
+
+	static size_t formatInteger(char* buffer, int64_t x);
+	static size_t formatInteger(char* buffer, uint64_t x);
+
+	static void appendReal(std::string &out, double x) {
+		char buffer[maxRealLength];
+		out.append(buffer, formatReal(buffer, x));
+	}
+
+	static void appendReal(std::string &out, float x) {
+		char buffer[maxRealLength];
+		out.append(buffer, formatReal(buffer, x));
+	}
+
+	static void appendInteger(std::string &out, int64_t x) {
+		char buffer[maxIntegerLength];
+		out.append(buffer, formatInteger(buffer, x));
+	}
+
+	static void appendInteger(std::string &out, uint64_t x) {
+		char buffer[maxIntegerLength];
+		out.append(buffer, formatInteger(buffer, x));
+	}
+
+	static std::ostream& printReal(std::ostream &os, double x) {
+		char buffer[maxRealLength];
+		return os.write(buffer, std::streamsize(formatReal(buffer, x)));
+	}
+
+	static std::ostream& printReal(std::ostream &os, float x) {
+		char buffer[maxRealLength];
+		return os.write(buffer, std::streamsize(formatReal(buffer, x)));
+	}
+
+	static std::ostream& printInteger(std::ostream &os, int64_t x) {
+		char buffer[maxIntegerLength];
+		return os.write(buffer, std::streamsize(formatInteger(buffer, x)));
+	}
+
+	static std::ostream& printInteger(std::ostream &os, uint64_t x) {
+		char buffer[maxIntegerLength];
+		return os.write(buffer, std::streamsize(formatInteger(buffer, x)));
+	}
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_NUMBERFORMAT_H
@@ -20,6 +20,10 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <cctype>
+#include <unordered_map>
+#include <mutex>
 
 #include "external/rapidjson/reader.h"
 #include "external/rapidjson/genericstream.h"
@@ -28,6 +32,8 @@
 #include <TSystem.h>
 #include <TBase64.h>
 
+#include "MappedFile.h"
+#include "NumberFormat.h"
 #include "format.h"
 
 
@@ -37,35 +43,56 @@ using namespace std;
 namespace dbrx {
 
 
+void PropKey::toJSON(std::string &out, const String &x) {
+	out.push_back('"');
+	// Append runs of characters that need no escaping in one go:
+	const char *p = x.data(), *end = x.data() + x.size(), *run = p;
+	for (; p != end; ++p) {
+		const char* escaped = nullptr;
+		switch (*p) {
+			case '\\': escaped = "\\\\"; break;
+			case '\f': escaped = "\\f"; break;
+			case '\n': escaped = "\\n"; break;
+			case '\r': escaped = "\\r"; break;
+			case '"': escaped = "\\\""; break;
+			default: continue;
+		}
+		out.append(run, p);
+		out.append(escaped, 2);
+		run = p + 1;
+	}
+	out.append(run, end);
+	out.push_back('"');
+}
+
+
 void PropKey::toJSON(std::ostream &out, const String &x) {
-	out << "\"";
-    for (char c: x) {
-        switch (c) {
-            case '\\': out << "\\\\"; break;
-            case '\f': out << "\\f"; break;
-            case '\n': out << "\\n"; break;
-            case '\r': out << "\\r"; break;
-            case '"': out << "\\\""; break;
-            default: out << c; break;
-        }
-    }
-	out << "\"";
+	std::string buffer;
+	toJSON(buffer, x);
+	out << buffer;
 }
 
 
-void PropKey::toJSON(std::ostream &out) const {
+void PropKey::toJSON(std::string &out) const {
 	switch (m_type) {
-		case Type::INTEGER: out << "\"" << m_content.i << "\""; break;
+		case Type::INTEGER: out.push_back('"'); NumberFormat::appendInteger(out, m_content.i); out.push_back('"'); break;
 		case Type::NAME: toJSON(out, m_content.n.str()); break;
 		default: assert(false);
 	}
 }
 
 
+void PropKey::toJSON(std::ostream &out) const {
+	std::string buffer;
+	toJSON(buffer);
+	out << buffer;
+}
+
+
 std::string PropKey::toJSON() const {
-	stringstream tmp;
-	toJSON(tmp);
-	return tmp.str();
+	std::string buffer;
+	toJSON(buffer);
+	return buffer;
 }
 
 
@@ -110,9 +137,10 @@ bool PropVal::comparisonImpl(const PropVal &other) const {
 				case Type::NAME: return m_content.s == other.m_content.n.str();
 				default: return false;
 			}
-		case Type::BYTES: return (other.m_type == Type::BYTES) && (*m_content.y == *other.m_content.y);
-		case Type::ARRAY: return (other.m_type == Type::ARRAY) && (*m_content.a == *other.m_content.a);
-		case Type::PROPS: return (other.m_type == Type::PROPS) && (*m_content.o == *other.m_content.o);
+		// Shared contents are equal without comparing them element by element
+		case Type::BYTES: return (other.m_type == Type::BYTES) && ((m_content.y == other.m_content.y) || (*m_content.y == *other.m_content.y));
+		case Type::ARRAY: return (other.m_type == Type::ARRAY) && ((m_content.a == other.m_content.a) || (*m_content.a == *other.m_content.a));
+		case Type::PROPS: return (other.m_type == Type::PROPS) && ((m_content.o == other.m_content.o) || (*m_content.o == *other.m_content.o));
 		default: assert(false);
 	}
 }
@@ -137,138 +165,210 @@ bool PropVal::substVarsImplContainsVar(const std::string &input) {
 }
 
 
-PropVal PropVal::substVarsImplSubstVars(const std::string &input, const Props &varValues, Props* envVarValues, bool ignoreMissing) {
-	size_t npos = input.npos;
-	stringstream result;
+class PropVal::SubstTemplate {
+protected:
+	struct Token {
+		bool isVar;
+		Name varName;
+		std::string text; // Literal text, or the variable expression
+	};
 
-	size_t nEscapes = 0;
-	size_t varBegin = npos;
-	size_t varEnd = npos;
-	bool varBraces = false;
-	size_t pos = 0;
+	std::string m_input;
+	std::vector<Token> m_tokens;
+	bool m_wholeVar = false;
+	size_t m_literalSize = 0;
 
-	while (pos < input.size()) {
-		char c = input[pos];
-		if (varBegin == npos) {
-			if (c == '\\') {
-				++nEscapes;
-				result << c;
-			} else {
-				if ((c == '$') && (nEscapes % 2 == 0) && (pos + 1 < input.size())) {
-					varBegin = pos + 1;
-					// if (! (varBegin < input.size())) throw invalid_argument("Encountered \"$\" at end of string \"%s\" during variable substitution"_format(input));
-				} else {
-					result << c;
-				}
-				nEscapes = 0;
-			}
-			++pos;
-		} else {
-			if (c == '{') {
-				if (varBraces) {
-					throw invalid_argument("Encountered extra \"{\" during variable substitution in string \"%s\""_format(input));
-				} else if (pos == varBegin) {
-					varBegin = pos + 1;
-					varBraces = true;
-					// if (! (varBegin < input.size())) throw invalid_argument("Encountered \"${\" at end of string \"%s\" during variable substitution"_format(input));
+	void addLiteral(char c) {
+		if (m_tokens.empty() || m_tokens.back().isVar) m_tokens.push_back({false, Name(), std::string()});
+		m_tokens.back().text.push_back(c);
+		++m_literalSize;
+	}
+
+	void addVar(size_t varBegin, size_t varEnd, size_t exprBegin, size_t exprEnd) {
+		m_tokens.push_back({true, Name(m_input.substr(varBegin, varEnd - varBegin)), m_input.substr(exprBegin, exprEnd - exprBegin)});
+		if ((exprBegin == 0) && (exprEnd == m_input.size())) m_wholeVar = true;
+	}
+
+	void compile() {
+		const std::string &input = m_input;
+		size_t npos = input.npos;
+
+		size_t nEscapes = 0;
+		size_t varBegin = npos;
+		size_t varEnd = npos;
+		bool varBraces = false;
+		size_t pos = 0;
+
+		while (pos < input.size()) {
+			char c = input[pos];
+			if (varBegin == npos) {
+				if (c == '\\') {
+					++nEscapes;
+					addLiteral(c);
 				} else {
-					varEnd = pos;
+					if ((c == '$') && (nEscapes % 2 == 0) && (pos + 1 < input.size())) {
+						varBegin = pos + 1;
+					} else {
+						addLiteral(c);
+					}
+					nEscapes = 0;
 				}
+				++pos;
 			} else {
-				if (!isalnum(c) && (c != '_')) {
+				if (c == '{') {
 					if (varBraces) {
-						if (c == '}') {
+						throw invalid_argument("Encountered extra \"{\" during variable substitution in string \"%s\""_format(input));
+					} else if (pos == varBegin) {
+						varBegin = pos + 1;
+						varBraces = true;
+					} else {
+						varEnd = pos;
+					}
+				} else {
+					if (!isalnum(c) && (c != '_')) {
+						if (varBraces) {
+							if (c == '}') {
+								varEnd = pos;
+								++pos;
+							} else if (c == '\\') {
+								throw invalid_argument("Encountered illegal \"\\\" character inside \"${...}\" during variable substitution in string \"%s\""_format(input));
+							}
+						} else {
 							varEnd = pos;
-							++pos;
-						} else if (c == '\\') {
-							throw invalid_argument("Encountered illegal \"\\\" character inside \"${...}\" during variable substitution in string \"%s\""_format(input));
 						}
+					} else if (isdigit(c) && (pos == varBegin)) {
+						throw invalid_argument("Illegal variable name, starting with a digit, during variable substitution in string \"%s\""_format(input));
+					}
+				}
+
+				if ( (varEnd == npos) && (pos + 1 == input.size()) ) {
+					if (varBraces) {
+						throw invalid_argument("Missing \"}\" for \"${\" during variable substitution in string \"%s\""_format(input));
 					} else {
+						++pos;
 						varEnd = pos;
 					}
-				} else if (isdigit(c) && (pos == varBegin)) {
-					throw invalid_argument("Illegal variable name, starting with a digit, during variable substitution in string \"%s\""_format(input));
 				}
-			}
 
-			if ( (varEnd == npos) && (pos + 1 == input.size()) ) {
-				if (varBraces) {
-					throw invalid_argument("Missing \"}\" for \"${\" during variable substitution in string \"%s\""_format(input));
+				if (varEnd != npos) {
+					if (varEnd > varBegin) {
+						size_t varExprBegin = varBraces ? varBegin - 2 : varBegin - 1;
+						size_t varExprEnd = varBraces ? varEnd + 1 : varEnd;
+						addVar(varBegin, varEnd, varExprBegin, varExprEnd);
+					} else {
+						if (varBraces) {
+							throw invalid_argument("Encountered illegal \"${}\" during variable substitution in string \"%s\""_format(input));
+						} else {
+							addLiteral(input[pos-1]);
+							addLiteral(input[pos]);
+							++pos;
+						}
+					}
+					varBegin = npos;
+					varEnd = npos;
+					varBraces = false;
 				} else {
 					++pos;
-					varEnd = pos;
 				}
 			}
+		}
+	}
 
-			if (varEnd != npos) {
-				if (varEnd > varBegin) {
-					Name varName(string(&input[varBegin], varEnd - varBegin));
-
-					const PropVal* foundValue = nullptr;
+	static const PropVal* lookup(Name varName, const Props &varValues, Props* envVarValues) {
+		auto found = varValues.find(varName);
+		if (found != varValues.end()) {
+			return &found->second;
+		} else if (envVarValues) {
+			auto foundEnv = envVarValues->find(varName);
+			if (foundEnv == envVarValues->end()) {
+				const char* valPtr = gSystem->Getenv(varName.c_str());
+				(*envVarValues)[varName] = PropVal::fromString(valPtr ? valPtr : "");
+				foundEnv = envVarValues->find(varName);
+			}
+			return &foundEnv->second;
+		}
+		else return nullptr;
+	}
 
-					auto found = varValues.find(varName);
-					if (found != varValues.end()) {
-						foundValue = &found->second;
-					} else if (envVarValues) {
-						auto foundEnv = envVarValues->find(varName);
-						if (foundEnv != envVarValues->end()) {
-							foundValue = &foundEnv->second;
-						} else {
-							const char* valPtr = gSystem->Getenv(varName.c_str());
-							PropVal value = PropVal::fromString(valPtr ? valPtr : "");
-							(*envVarValues)[varName] = value;
-							foundValue = &envVarValues->at(varName);
-						}
-					}
+public:
+	PropVal apply(const Props &varValues, Props* envVarValues, bool ignoreMissing) const {
+		if (m_wholeVar) {
+			const PropVal* value = lookup(m_tokens.front().varName, varValues, envVarValues);
+			if (value) return *value;
+		}
 
-					size_t varExprBegin = varBraces ? varBegin - 2 : varBegin - 1;
-					size_t varExprEnd = varBraces ? varEnd + 1 : varEnd;
-					if (foundValue) {
-						if ((varExprBegin == 0) && (varExprEnd == input.size())) {
-							return *foundValue;
-						}
-						result << *foundValue;
-					} else {
-						if (ignoreMissing) for (size_t i = varExprBegin; i < varExprEnd; ++i) result << input[i];
-						else throw invalid_argument("Unknown variable \"%s\" during variable substitution in string \"%s\""_format(varName, input));
+		std::string result;
+		result.reserve(m_literalSize + 16 * m_tokens.size());
+		for (const Token &token: m_tokens) {
+			if (! token.isVar) {
+				result.append(token.text);
+			} else {
+				const PropVal* value = lookup(token.varName, varValues, envVarValues);
+				if (value) {
+					// Same representation as PropVal::print:
+					switch (value->type()) {
+						case Type::NAME: result.append(value->asName().str()); break;
+						case Type::STRING: result.append(value->asString()); break;
+						default: value->toJSON(result);
 					}
 				} else {
-					if (varBraces) {
-						throw invalid_argument("Encountered illegal \"${}\" during variable substitution in string \"%s\""_format(input));
-					} else {
-						result << input[pos-1] << input[pos];
-						++pos;
-					}
+					if (ignoreMissing) result.append(token.text);
+					else throw invalid_argument("Unknown variable \"%s\" during variable substitution in string \"%s\""_format(token.varName, m_input));
 				}
-				varBegin = npos;
-				varEnd = npos;
-				varBraces = false;
-			} else {
-				++pos;
 			}
 		}
+		return PropVal(std::move(result));
 	}
 
-	return result.str();
-}
+	// The same strings are usually substituted several times (per config
+	// file and again on finalize), so compiled templates are cached:
+	static std::shared_ptr<const SubstTemplate> get(const std::string &input) {
+		static std::mutex cacheMutex;
+		static std::unordered_map<std::string, std::shared_ptr<const SubstTemplate>> cache;
 
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto found = cache.find(input);
+		if (found != cache.end()) return found->second;
 
-void PropVal::substVarsImpl(const Props &varValues, Props* envVarValues, bool ignoreMissing) {
+		auto compiled = std::make_shared<const SubstTemplate>(input);
+		if (cache.size() >= 100000) cache.clear();
+		cache[input] = compiled;
+		return compiled;
+	}
+
+	SubstTemplate(const std::string &input): m_input(input) { compile(); }
+};
+
+
+bool PropVal::substVarsImpl(PropVal &result, const Props &varValues, Props* envVarValues, bool ignoreMissing) const {
 	if (m_type == Type::STRING) {
-		const std::string &x = m_content.s;
-		if (substVarsImplContainsVar(x))
-			*this = substVarsImplSubstVars(x, varValues, envVarValues, ignoreMissing);
+		if (! substVarsImplContainsVar(m_content.s)) return false;
+		result = SubstTemplate::get(m_content.s)->apply(varValues, envVarValues, ignoreMissing);
+		return true;
 	} else if (m_type == Type::ARRAY) {
-		Array &x = *m_content.a;
-		for (auto &v: x) {
-			v.substVarsImpl(varValues, envVarValues, ignoreMissing);
+		const Array &x = *m_content.a;
+		Array* changed = nullptr;
+		PropVal substituted;
+		for (size_t i = 0; i < x.size(); ++i) {
+			if (x[i].substVarsImpl(substituted, varValues, envVarValues, ignoreMissing)) {
+				if (! changed) { result = *this; changed = &result.asArray(); }
+				(*changed)[i] = std::move(substituted);
+			}
 		}
+		return changed != nullptr;
 	} else if (m_type == Type::PROPS) {
-		Props &x = *m_content.o;
-		for (auto &e: x) {
-			e.second.substVarsImpl(varValues, envVarValues, ignoreMissing);
+		const Props &x = *m_content.o;
+		Props* changed = nullptr;
+		PropVal substituted;
+		for (const auto &e: x) {
+			if (e.second.substVarsImpl(substituted, varValues, envVarValues, ignoreMissing)) {
+				if (! changed) { result = *this; changed = &result.asProps(); }
+				(*changed)[e.first] = std::move(substituted);
+			}
 		}
+		return changed != nullptr;
 	}
+	else return false;
 }
 
 
@@ -310,21 +410,22 @@ bool operator==(const Props &a, const Props &b) {
 
 
 void PropVal::substVars(const Props &varValues, bool useEnvVars, bool ignoreMissing) {
+	PropVal result;
+	bool changed = false;
 	if (useEnvVars) {
 		Props envVarValues;
-		substVarsImpl(varValues, &envVarValues, ignoreMissing);
+		changed = substVarsImpl(result, varValues, &envVarValues, ignoreMissing);
 	} else {
-		substVarsImpl(varValues, nullptr, ignoreMissing);
+		changed = substVarsImpl(result, varValues, nullptr, ignoreMissing);
 	}
+	if (changed) *this = std::move(result);
 }
 
 
 void PropVal::toJSON(std::ostream &out, Real x) {
-	if (x != x) toJSON(out, nullptr); // NaN
-	else {
-		out.precision(16);
-		out << x;
-	}
+	std::string buffer;
+	toJSON(buffer, x);
+	out << buffer;
 }
 
 
@@ -334,25 +435,70 @@ void PropVal::toJSON(std::ostream &out, Name x) {
 
 
 void PropVal::toJSON(std::ostream &out, const Bytes &x) {
-	out << "\"data:,";
-	out << TBase64::Encode((const char*)(x.data()), x.size());
-	out << "\"";
+	std::string buffer;
+	toJSON(buffer, x);
+	out << buffer;
 }
 
 
 void PropVal::toJSON(std::ostream &out, const Array &x) {
-	out << "[";
+	std::string buffer;
+	toJSON(buffer, x);
+	out << buffer;
+}
+
+
+void PropVal::toJSON(std::ostream &out, const Props &x) {
+	std::string buffer;
+	toJSON(buffer, x);
+	out << buffer;
+}
+
+
+void PropVal::toJSON(std::ostream &out) const {
+	std::string buffer;
+	toJSON(buffer);
+	out << buffer;
+}
+
+
+void PropVal::toJSON(std::string &out, Integer x) {
+	NumberFormat::appendInteger(out, x);
+}
+
+
+void PropVal::toJSON(std::string &out, Real x) {
+	if (x != x) toJSON(out, nullptr); // NaN
+	else NumberFormat::appendReal(out, x);
+}
+
+
+void PropVal::toJSON(std::string &out, Name x) {
+	toJSON(out, x.str());
+}
+
+
+void PropVal::toJSON(std::string &out, const Bytes &x) {
+	TString encoded = TBase64::Encode((const char*)(x.data()), x.size());
+	out.append("\"data:,");
+	out.append(encoded.Data(), size_t(encoded.Length()));
+	out.push_back('"');
+}
+
+
+void PropVal::toJSON(std::string &out, const Array &x) {
+	out.push_back('[');
 	bool first = true;
 	for (auto const &v: x) {
-		if (!first) out << ", ";
+		if (!first) out.append(", ");
 		v.toJSON(out);
 		first = false;
 	}
-	out << "]";
+	out.push_back(']');
 }
 
 
-void PropVal::toJSON(std::ostream &out, const Props &x) {
+void PropVal::toJSON(std::string &out, const Props &x) {
 	using CPRef = std::pair<PropKey, const PropVal*>;
 	vector<CPRef> props;
 	props.reserve(x.size());
@@ -361,20 +507,20 @@ void PropVal::toJSON(std::ostream &out, const Props &x) {
 	auto compare = [](const CPRef &a, const CPRef &b) { return a.first < b.first; };
 	sort(props.begin(), props.end(), compare);
 
-	out << "{";
+	out.push_back('{');
 	bool first = true;
 	for (auto const &e: props) {
-		if (!first) out << ", ";
+		if (!first) out.append(", ");
 		e.first.toJSON(out);
-		out << ": ";
+		out.append(": ");
 		e.second->toJSON(out);
 		first = false;
 	}
-	out << "}";
+	out.push_back('}');
 }
 
 
-void PropVal::toJSON(std::ostream &out) const {
+void PropVal::toJSON(std::string &out) const {
 	switch (m_type) {
 		case Type::NONE: toJSON(out, m_content.e); break;
 		case Type::BOOL: toJSON(out, m_content.b); break;
@@ -390,111 +536,367 @@ void PropVal::toJSON(std::ostream &out) const {
 }
 
 
-PropVal PropVal::fromJSON(std::istream &in) {
+namespace {
+
+// Builds a PropVal from rapidjson SAX events. Values are moved (never
+// copied) into their parent containers, object keys are resolved via a
+// per-parse cache, so repeated keys don't go through the NameTable again.
+
+class JSONPropValBuilder {
+public:
 	using Encoding = typename rapidjson::UTF8<>;
-	using rapidjson::SizeType;
-
-	class JSONHandler {
-	public:
-		using Ch = typename Encoding::Ch;
-
-	protected:
-		std::vector<PropVal> m_valueStack;
-
-		PropVal decodeString(const Ch* str, SizeType length) {
-			if ((length >= 6) && (str[0] == 'd') && (str[1] == 'a') && (str[2] == 't') && (str[3] == 'a') && (str[4] == ':') && (str[5] == ',')) {
-				assert(str[length] == 0);
-				TString decoded = TBase64::Decode(str + 6);
-				Bytes bytes(decoded.Length());
-				const char* decodedData = decoded.Data();
-				for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = uint8_t(decodedData[i]);
-				return bytes;
-			} else {
-				return string(str, length);
-			}
+	using Ch = typename Encoding::Ch;
+	using SizeType = rapidjson::SizeType;
+
+protected:
+	std::vector<PropVal> m_valueStack;
+	std::vector<PropKey> m_keyStack;
+
+	// One entry per open container, true for objects:
+	std::vector<bool> m_isObject;
+	bool m_expectKey = false;
+
+	std::unordered_map<std::string, PropKey> m_keyCache;
+	std::string m_keyTmp;
+
+	PropVal decodeString(const Ch* str, SizeType length) {
+		if ((length >= 6) && (str[0] == 'd') && (str[1] == 'a') && (str[2] == 't') && (str[3] == 'a') && (str[4] == ':') && (str[5] == ',')) {
+			assert(str[length] == 0);
+			TString decoded = TBase64::Decode(str + 6);
+			PropVal::Bytes bytes(decoded.Length());
+			const char* decodedData = decoded.Data();
+			for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = uint8_t(decodedData[i]);
+			return bytes;
+		} else {
+			return string(str, length);
 		}
+	}
 
-		void popCurrent() { m_valueStack.pop_back(); }
+	void storeKey(const Ch* str, SizeType length) {
+		m_keyTmp.assign(str, length);
+		auto found = m_keyCache.find(m_keyTmp);
+		if (found == m_keyCache.end()) found = m_keyCache.emplace(m_keyTmp, PropKey(m_keyTmp)).first;
+		m_keyStack.push_back(found->second);
+		m_expectKey = false;
+	}
 
-		void store(PropVal &&pIn) {
-			if (m_valueStack.capacity() == m_valueStack.size())
-				m_valueStack.reserve(m_valueStack.size() * 2);
-			m_valueStack.push_back(std::move(pIn));
-		}
+	void store(PropVal &&pIn) {
+		m_valueStack.push_back(std::move(pIn));
+		m_expectKey = !m_isObject.empty() && m_isObject.back();
+	}
 
-	public:
-		void Null_() { store(PropVal()); }
+public:
+	void Null_() { store(PropVal()); }
 
-		void Bool_(bool b) { store(b); }
+	void Bool_(bool b) { store(b); }
 
-		void Int(int i) { store(int64_t(i)); }
-		void Uint(unsigned i) { store(int64_t(i)); }
-		void Int64(int64_t i) { store(i); }
-		void Uint64(uint64_t i) { store(int64_t(i)); }
+	void Int(int i) { store(int64_t(i)); }
+	void Uint(unsigned i) { store(int64_t(i)); }
+	void Int64(int64_t i) { store(i); }
+	void Uint64(uint64_t i) { store(int64_t(i)); }
 
-		void Double(double d) { store(d); }
+	void Double(double d) { store(d); }
 
-		void String(const Ch* str, SizeType length, bool copy) { store(decodeString(str, length)); }
+	void String(const Ch* str, SizeType length, bool copy) {
+		if (m_expectKey) storeKey(str, length);
+		else store(decodeString(str, length));
+	}
 
-		void StartObject() {}
+	void StartObject() { m_isObject.push_back(true); m_expectKey = true; }
 
-		void EndObject(SizeType memberCount) {
-			if (m_valueStack.size() < memberCount * 2) throw logic_error("Parsing stack size mismatch on object");
-			PropVal objProp = PropVal::props();
-			Props obj = objProp.asProps();
-			for (auto p = m_valueStack.end() - memberCount * 2; p < m_valueStack.end();) {
-				PropKey k(std::move(*p++));
-				obj[std::move(k)] = std::move(*p++);
-			}
-			m_valueStack.resize(m_valueStack.size() - 2 * memberCount);
-			store(std::move(obj));
-		}
+	void EndObject(SizeType memberCount) {
+		if ((m_valueStack.size() < memberCount) || (m_keyStack.size() < memberCount))
+			throw logic_error("Parsing stack size mismatch on object");
 
-		void StartArray() {}
-
-		void EndArray(SizeType elementCount) {
-			if (m_valueStack.size() < elementCount) throw logic_error("Parsing stack size mismatch on array");
-			PropVal arrayProp = PropVal::array();
-			Array arr = arrayProp.asArray();
-			arr.reserve(elementCount);
-			for (auto p = m_valueStack.end() - elementCount; p < m_valueStack.end(); ++p)
-				arr.push_back(std::move(*p));
-			m_valueStack.resize(m_valueStack.size() - elementCount);
-			store(std::move(arr));
-		}
+		// Inserted in reverse order, so the last of duplicate keys wins (as
+		// the bulk insert keeps the first occurrence):
+		std::vector<Props::value_type> entries;
+		entries.reserve(memberCount);
+		auto k = m_keyStack.end();
+		auto v = m_valueStack.end();
+		for (SizeType i = 0; i < memberCount; ++i) entries.emplace_back(std::move(*--k), std::move(*--v));
+		m_keyStack.resize(m_keyStack.size() - memberCount);
+		m_valueStack.resize(m_valueStack.size() - memberCount);
 
-		PropVal& getResult() {
-			if (m_valueStack.size() != 1) throw logic_error("Parsing stack size mismatch - expected size 1");
-			return m_valueStack.front();
-		}
+		m_isObject.pop_back();
+		store(Props(make_move_iterator(entries.begin()), make_move_iterator(entries.end())));
+	}
 
-		JSONHandler() {
-			m_valueStack.reserve(8);
-		}
-	};
+	void StartArray() { m_isObject.push_back(false); m_expectKey = false; }
+
+	void EndArray(SizeType elementCount) {
+		if (m_valueStack.size() < elementCount) throw logic_error("Parsing stack size mismatch on array");
+		PropVal::Array arr;
+		arr.reserve(elementCount);
+		for (auto p = m_valueStack.end() - elementCount; p < m_valueStack.end(); ++p)
+			arr.push_back(std::move(*p));
+		m_valueStack.resize(m_valueStack.size() - elementCount);
+
+		m_isObject.pop_back();
+		store(std::move(arr));
+	}
+
+	PropVal& getResult() {
+		if (m_valueStack.size() != 1) throw logic_error("Parsing stack size mismatch - expected size 1");
+		return m_valueStack.front();
+	}
+
+	template<unsigned parseFlags, typename Stream> PropVal parse(Stream &in) {
+		rapidjson::GenericReader<Encoding> reader;
+		if (! reader.Parse<parseFlags, Stream, JSONPropValBuilder>(in, *this))
+			throw invalid_argument("JSON parse error at offset %s: %s"_format(reader.GetErrorOffset(), reader.GetParseError()));
+		return PropVal( std::move(getResult()) );
+	}
+
+	JSONPropValBuilder() {
+		m_valueStack.reserve(64);
+		m_keyStack.reserve(64);
+	}
+};
+
+} // namespace
 
-	rapidjson::GenericReadStream genericIn(in);
 
-	rapidjson::GenericReader<Encoding> reader;
-	JSONHandler handler;
+PropVal PropVal::fromJSON(std::istream &in) {
+	rapidjson::GenericReadStream genericIn(in);
+	return JSONPropValBuilder().parse<rapidjson::kParseDefaultFlags>(genericIn);
+}
 
-	if (! reader.Parse<rapidjson::kParseDefaultFlags, rapidjson::GenericReadStream, JSONHandler> (genericIn, handler))
-		throw invalid_argument("JSON parse error, input is not valid JSON");
 
-	return PropVal( std::move(handler.getResult()) );
+PropVal PropVal::fromJSONInsitu(char* json) {
+	rapidjson::GenericInsituStringStream<JSONPropValBuilder::Encoding> in(json);
+	return JSONPropValBuilder().parse<rapidjson::kParseInsituFlag>(in);
 }
 
 
 std::string PropVal::toJSON() const {
-	stringstream tmp;
-	toJSON(tmp);
-	return tmp.str();
+	std::string buffer;
+	toJSON(buffer);
+	return buffer;
 }
 
 
 PropVal PropVal::fromJSON(const std::string &in) {
-	stringstream tmp(in);
-	return fromJSON(tmp);
+	// One copy to get a writable buffer is much cheaper than parsing via
+	// a stringstream:
+	std::string buffer(in);
+	return fromJSONInsitu(&buffer[0]);
+}
+
+
+// Binary format: One tag byte (the value of PropVal::Type), followed by
+//
+//   NONE:            -
+//   BOOL:            one byte (0 or 1)
+//   INTEGER:         zigzag-encoded varint
+//   REAL:            IEEE 754 double, little endian
+//   NAME, STRING:    varint size, characters
+//   BYTES:           varint size, raw bytes
+//   ARRAY:           varint number of elements, elements
+//   PROPS:           varint number of entries, pairs of key (tag INTEGER or
+//                    NAME, encoded as above) and value
+
+namespace {
+
+void putVarint(std::string &out, uint64_t x) {
+	while (x >= 0x80) {
+		out.push_back(char(uint8_t(x) | 0x80));
+		x >>= 7;
+	}
+	out.push_back(char(uint8_t(x)));
+}
+
+void putTag(std::string &out, PropVal::Type type) { out.push_back(char(type)); }
+
+void putInteger(std::string &out, PropVal::Integer x) {
+	putTag(out, PropVal::Type::INTEGER);
+	putVarint(out, (uint64_t(x) << 1) ^ uint64_t(x >> 63));
+}
+
+void putChars(std::string &out, PropVal::Type type, const char* data, size_t size) {
+	putTag(out, type);
+	putVarint(out, size);
+	out.append(data, size);
+}
+
+
+void checkAvail(const char* pos, const char* end, size_t n) {
+	if (size_t(end - pos) < n) throw runtime_error("Unexpected end of binary PropVal data");
+}
+
+uint64_t getVarint(const char* &pos, const char* end) {
+	uint64_t x = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		checkAvail(pos, end, 1);
+		uint8_t b = uint8_t(*pos++);
+		x |= uint64_t(b & 0x7f) << shift;
+		if (!(b & 0x80)) return x;
+	}
+	throw runtime_error("Invalid varint in binary PropVal data");
+}
+
+PropVal::Type getTag(const char* &pos, const char* end) {
+	checkAvail(pos, end, 1);
+	uint8_t tag = uint8_t(*pos++);
+	if (tag > uint8_t(PropVal::Type::PROPS)) throw runtime_error("Invalid type tag %s in binary PropVal data"_format(int(tag)));
+	return PropVal::Type(tag);
+}
+
+PropVal::Integer getInteger(const char* &pos, const char* end) {
+	uint64_t x = getVarint(pos, end);
+	return PropVal::Integer((x >> 1) ^ (~(x & 1) + 1));
+}
+
+size_t getSize(const char* &pos, const char* end) {
+	uint64_t n = getVarint(pos, end);
+	checkAvail(pos, end, 0);
+	if (n > uint64_t(end - pos)) throw runtime_error("Unexpected end of binary PropVal data");
+	return size_t(n);
+}
+
+} // namespace
+
+
+void PropVal::toBinary(std::string &out) const {
+	switch (m_type) {
+		case Type::NONE: putTag(out, m_type); break;
+		case Type::BOOL: putTag(out, m_type); out.push_back(char(m_content.b ? 1 : 0)); break;
+		case Type::INTEGER: putInteger(out, m_content.i); break;
+		case Type::REAL: {
+			uint64_t bits;
+			memcpy(&bits, &m_content.r, sizeof(bits));
+			putTag(out, m_type);
+			for (int i = 0; i < 8; ++i) out.push_back(char(uint8_t(bits >> (8 * i))));
+			break;
+		}
+		case Type::NAME: putChars(out, m_type, m_content.n.str().data(), m_content.n.str().size()); break;
+		case Type::STRING: putChars(out, m_type, m_content.s.data(), m_content.s.size()); break;
+		case Type::BYTES: putChars(out, m_type, (const char*)(m_content.y->data()), m_content.y->size()); break;
+		case Type::ARRAY:
+			putTag(out, m_type);
+			putVarint(out, m_content.a->size());
+			for (const auto &v: *m_content.a) v.toBinary(out);
+			break;
+		case Type::PROPS:
+			putTag(out, m_type);
+			putVarint(out, m_content.o->size());
+			for (const auto &e: *m_content.o) {
+				if (e.first.isInteger()) putInteger(out, e.first.asInteger());
+				else putChars(out, Type::NAME, e.first.asName().str().data(), e.first.asName().str().size());
+				e.second.toBinary(out);
+			}
+			break;
+		default: assert(false);
+	}
+}
+
+
+std::string PropVal::toBinary() const {
+	std::string out;
+	toBinary(out);
+	return out;
+}
+
+
+PropVal PropVal::fromBinary(const char* &pos, const char* end) {
+	Type type = getTag(pos, end);
+	switch (type) {
+		case Type::NONE: return PropVal();
+		case Type::BOOL: checkAvail(pos, end, 1); return PropVal(bool(*pos++));
+		case Type::INTEGER: return PropVal(getInteger(pos, end));
+		case Type::REAL: {
+			checkAvail(pos, end, 8);
+			uint64_t bits = 0;
+			for (int i = 0; i < 8; ++i) bits |= uint64_t(uint8_t(*pos++)) << (8 * i);
+			Real x;
+			memcpy(&x, &bits, sizeof(x));
+			return PropVal(x);
+		}
+		case Type::NAME: case Type::STRING: {
+			size_t n = getSize(pos, end);
+			String s(pos, n);
+			pos += n;
+			return (type == Type::NAME) ? PropVal(Name(s)) : PropVal(std::move(s));
+		}
+		case Type::BYTES: {
+			size_t n = getSize(pos, end);
+			const uint8_t *data = reinterpret_cast<const uint8_t*>(pos);
+			pos += n;
+			return PropVal(Bytes(data, data + n));
+		}
+		case Type::ARRAY: {
+			// Each element needs at least one byte:
+			size_t n = getSize(pos, end);
+			PropVal result = PropVal::array();
+			Array &arr = result.asArray();
+			arr.reserve(n);
+			for (size_t i = 0; i < n; ++i) arr.push_back(fromBinary(pos, end));
+			return result;
+		}
+		case Type::PROPS: {
+			// Key ids depend on the process, so entries are sorted once at the end:
+			uint64_t n = getVarint(pos, end);
+			std::vector<Props::value_type> entries;
+			entries.reserve(std::min(n, uint64_t(end - pos) / 2));
+			for (uint64_t i = 0; i < n; ++i) {
+				Type keyType = getTag(pos, end);
+				PropKey key;
+				if (keyType == Type::INTEGER) {
+					key = PropKey(getInteger(pos, end));
+				} else if (keyType == Type::NAME) {
+					size_t n = getSize(pos, end);
+					key = PropKey(Name(String(pos, n)));
+					pos += n;
+				} else {
+					throw runtime_error("Invalid key type in binary PropVal data");
+				}
+				PropVal value = fromBinary(pos, end);
+				entries.emplace_back(std::move(key), std::move(value));
+			}
+			PropVal result = PropVal::props();
+			result.asProps().insert(make_move_iterator(entries.begin()), make_move_iterator(entries.end()));
+			return result;
+		}
+		default: assert(false);
+	}
+	return PropVal();
+}
+
+
+PropVal PropVal::fromBinary(const std::string &in) {
+	const char *pos = in.data();
+	const char *end = pos + in.size();
+	PropVal result = fromBinary(pos, end);
+	if (pos != end) throw runtime_error("Unexpected trailing data after binary PropVal");
+	return result;
+}
+
+
+const std::string& PropVal::binaryFileMagic() {
+	static const std::string magic("dbrxPV1\n");
+	return magic;
+}
+
+
+void PropVal::writeBinaryRecord(std::ostream &out, const std::string &encoded) {
+	if (encoded.size() > numeric_limits<uint32_t>::max()) throw runtime_error("Binary PropVal record too large");
+	uint32_t n = uint32_t(encoded.size());
+	char size[4] = { char(uint8_t(n)), char(uint8_t(n >> 8)), char(uint8_t(n >> 16)), char(uint8_t(n >> 24)) };
+	out.write(size, 4);
+	out.write(encoded.data(), encoded.size());
+}
+
+
+bool PropVal::readBinaryRecord(std::istream &in, std::string &encoded) {
+	char size[4];
+	if (!in.read(size, 4)) {
+		if (in.gcount() == 0) return false;
+		else throw runtime_error("Unexpected end of binary PropVal record");
+	}
+	uint32_t n = uint32_t(uint8_t(size[0])) | uint32_t(uint8_t(size[1])) << 8 | uint32_t(uint8_t(size[2])) << 16 | uint32_t(uint8_t(size[3])) << 24;
+	encoded.resize(n);
+	if (n > 0 && !in.read(&encoded[0], n)) throw runtime_error("Unexpected end of binary PropVal record");
+	return true;
 }
 
 
@@ -505,6 +907,10 @@ void PropVal::toFile(const std::string &outFileName) const {
 		ofstream out(fileName.Data());
 		toJSON(out);
 		out << "\n";
+	} else if (fileName.EndsWith(".dbrxb")) {
+		ofstream out(fileName.Data(), ios::binary);
+		out << binaryFileMagic();
+		writeBinaryRecord(out, toBinary());
 	} else throw runtime_error("Unsupported input file type for PropVal");
 }
 
@@ -513,8 +919,30 @@ PropVal PropVal::fromFile(const std::string &inFileName) {
 	TString fileName(inFileName);
 
 	if (fileName.EndsWith(".json")) {
-		ifstream in(fileName.Data());
-		return fromJSON(in);
+		if (MappedFile::isMappable(inFileName)) {
+			// Parse in place in the (private, copy-on-write) mapping. Needs a
+			// trailing whitespace character to hold the terminating null:
+			MappedFile mapped(inFileName);
+			if ((mapped.size() > 0) && isspace(mapped.data()[mapped.size() - 1])) {
+				mapped.advise(MappedFile::Advice::Sequential);
+				mapped.data()[mapped.size() - 1] = 0;
+				return fromJSONInsitu(mapped.data());
+			} else {
+				std::string buffer(mapped.data(), mapped.size());
+				return fromJSONInsitu(&buffer[0]);
+			}
+		} else {
+			ifstream in(fileName.Data());
+			return fromJSON(in);
+		}
+	} else if (fileName.EndsWith(".dbrxb")) {
+		ifstream in(fileName.Data(), ios::binary);
+		string magic(binaryFileMagic().size(), '\0');
+		in.read(&magic[0], magic.size());
+		if (!in || (magic != binaryFileMagic())) throw runtime_error("\"%s\" is not a binary PropVal file"_format(inFileName));
+		string encoded;
+		if (!readBinaryRecord(in, encoded)) throw runtime_error("Binary PropVal file \"%s\" contains no value"_format(inFileName));
+		return fromBinary(encoded);
 	} else throw runtime_error("Unsupported input file type for PropVal");
 }
 
@@ -602,6 +1030,10 @@ Props PropVal::diff(const Props &a, const Props &b) {
 
 
 Props& PropVal::patchMerge(Props &a, Props b, bool merge) {
+	// Entries only present in b are collected and inserted into a in one
+	// pass at the end, inserting them one by one would invalidate itA:
+	std::vector<Props::value_type> added;
+
 	auto itA = a.begin(), itB = b.begin();
 
 	while ((itA != a.end()) && (itB != b.end())) {
@@ -622,18 +1054,18 @@ Props& PropVal::patchMerge(Props &a, Props b, bool merge) {
 		} else if (PropKey::CompareById()(keyA, keyB)) {
 			++itA;
 		} else {
-			a[keyB] = std::move(valB);
+			added.push_back(std::move(*itB));
 			++itB;
 		}
 	}
 
 	while (itB != b.end()) {
-		const auto &keyB = itB->first;
-		auto &valB = itB->second;
-		a[keyB] = std::move(valB);
+		added.push_back(std::move(*itB));
 		++itB;
 	}
 
+	if (!added.empty()) a.insert(make_move_iterator(added.begin()), make_move_iterator(added.end()));
+
 	return a;
 }
 
@@ -650,6 +1082,14 @@ std::ostream& PropPath::Fragment::print(std::ostream &os) const {
 
 
 PropPath& PropPath::operator=(const std::string& path) {
+	static std::mutex internedMutex;
+	static std::unordered_map<std::string, PropPath> interned;
+
+	std::lock_guard<std::mutex> lock(internedMutex);
+	auto found = interned.find(path);
+	if (found != interned.end()) return *this = found->second;
+
+	m_elements.clear();
 	size_t from = 0;
 	for (size_t i = 0; i < path.size(); ++i) {
 		if (path[i] == '.') {
@@ -660,6 +1100,9 @@ PropPath& PropPath::operator=(const std::string& path) {
 		}
 	}
 	if (from < path.size()) m_elements.push_back(PropKey(path.substr(from, path.size() - from)));
+
+	if (interned.size() >= 100000) interned.clear();
+	interned.emplace(path, *this);
 	return *this;
 }
 
@@ -670,6 +1113,7 @@ PropPath& PropPath::operator=(const PropVal& propVal) {
 	else if (propVal.isString()) *this = propVal.asString();
 	else if (propVal.isArray()) {
 		const auto& a = propVal.asArray();
+		m_elements.clear();
 		m_elements.reserve(a.size());
 		for (const auto& x: a) m_elements.push_back(x);
 	} else throw std::invalid_argument("Can't initialize PropPath from content of this PropVal");
@@ -30,6 +30,8 @@
 
 #include "Name.h"
 #include "Printable.h"
+#include "FlatMap.h"
+#include "SmallVector.h"
 
 
 namespace dbrx {
@@ -172,8 +174,10 @@ public:
 
 
 	static void toJSON(std::ostream &out, const String &x);
+	static void toJSON(std::string &out, const String &x);
 
 	void toJSON(std::ostream &out) const;
+	void toJSON(std::string &out) const;
 	std::string toJSON() const;
 
 	std::ostream& print(std::ostream &os) const override;
@@ -184,7 +188,7 @@ public:
 	PropKey(const PropKey &other)
 		: m_type(other.m_type), m_content(other.m_type, other.m_content) {}
 
-	PropKey(PropKey &&other) {
+	PropKey(PropKey &&other) noexcept {
 		using namespace std;
 		swap(*this, other);
 	}
@@ -247,7 +251,7 @@ public:
 	using String = PropKey::String;
 	using Bytes = std::vector<uint8_t>;
 	using Array = std::vector<PropVal>;
-	using Props = std::map<PropKey, PropVal, PropKey::CompareById>;
+	using Props = FlatMap<PropKey, PropVal, PropKey::CompareById>;
 
 
 	template<typename T> static void swapMem(T &a, T &b) noexcept { PropKey::swapMem(a, b); }
@@ -264,9 +268,18 @@ public:
 	}
 
 protected:
-	using BytesPtr = std::unique_ptr<Bytes>;
-	using ArrayPtr = std::unique_ptr<Array>;
-	using PropsPtr = std::unique_ptr<Props>;
+	// Bytes, array and props contents are shared between copies of a PropVal
+	// and only cloned on non-const access (copy-on-write). So copying a
+	// PropVal is O(1), but references obtained via non-const accessors must
+	// not be used to modify the value after it has been copied.
+	using BytesPtr = std::shared_ptr<Bytes>;
+	using ArrayPtr = std::shared_ptr<Array>;
+	using PropsPtr = std::shared_ptr<Props>;
+
+	template<typename T> static T& unshared(std::shared_ptr<T> &ptr) {
+		if (ptr.use_count() > 1) ptr = std::make_shared<T>(*ptr);
+		return *ptr;
+	}
 
 	union Content {
 		None e;
@@ -287,11 +300,11 @@ protected:
 		Content(Real value) : r(std::move(value)) { }
 		Content(Name value) : n(std::move(value)) { }
 		Content(String value) : s(std::move(value)) { }
-		Content(Bytes value) : y( new Bytes(std::move(value)) ) { }
-		Content(Array value) : a( new Array(std::move(value)) ) { }
-		Content(Props value) : o( new Props(std::move(value)) ) { }
+		Content(Bytes value) : y( std::make_shared<Bytes>(std::move(value)) ) { }
+		Content(Array value) : a( std::make_shared<Array>(std::move(value)) ) { }
+		Content(Props value) : o( std::make_shared<Props>(std::move(value)) ) { }
 
-		Content(std::initializer_list<PropVal> init) : a(new Array(init)) { }
+		Content(std::initializer_list<PropVal> init) : a(std::make_shared<Array>(init)) { }
 
 		Content(Type type) {
 			switch (type) {
@@ -301,9 +314,9 @@ protected:
 				case Type::REAL: new (&r) Real(); break;
 				case Type::NAME: new (&n) Name(); break;
 				case Type::STRING: new (&s) String(); break;
-				case Type::BYTES: new (&y) BytesPtr(new Bytes()); break;
-				case Type::ARRAY: new (&a) ArrayPtr(new Array()); break;
-				case Type::PROPS: new (&o) PropsPtr(new Props()); break;
+				case Type::BYTES: new (&y) BytesPtr(std::make_shared<Bytes>()); break;
+				case Type::ARRAY: new (&a) ArrayPtr(std::make_shared<Array>()); break;
+				case Type::PROPS: new (&o) PropsPtr(std::make_shared<Props>()); break;
 				default: assert(false);
 			}
 		}
@@ -316,9 +329,9 @@ protected:
 				case Type::REAL: new (&r) Real(other.r); break;
 				case Type::NAME: new (&n) Name(other.n); break;
 				case Type::STRING: new (&s) String(other.s); break;
-				case Type::BYTES: new (&y) BytesPtr(new Bytes(*other.y)); break;
-				case Type::ARRAY: new (&a) ArrayPtr(new Array(*other.a)); break;
-				case Type::PROPS: new (&o) PropsPtr(new Props(*other.o)); break;
+				case Type::BYTES: new (&y) BytesPtr(other.y); break;
+				case Type::ARRAY: new (&a) ArrayPtr(other.a); break;
+				case Type::PROPS: new (&o) PropsPtr(other.o); break;
 				default: assert(false);
 			}
 		}
@@ -343,9 +356,15 @@ protected:
 
 	bool comparisonImpl(const PropVal &other) const;
 
+	// String with variable references, precompiled into literal text and
+	// variable tokens (see Props.cxx):
+	class SubstTemplate;
+
 	static bool substVarsImplContainsVar(const std::string &input);
-	static PropVal substVarsImplSubstVars(const std::string &input, const Props &varValues, Props* envVarValues, bool ignoreMissing);
-	void substVarsImpl(const Props &varValues, Props* envVarValues, bool ignoreMissing);
+
+	// Sets result and returns true if substitution changes the value,
+	// contents without variable references stay shared:
+	bool substVarsImpl(PropVal &result, const Props &varValues, Props* envVarValues, bool ignoreMissing) const;
 
 	static const PropVal s_noneValue;
 
@@ -413,6 +432,13 @@ public:
 		}
 	}
 
+	// Reuses the existing string storage if this is already a string
+	PropVal& setString(const char* value, size_t length) {
+		if (m_type == Type::STRING) m_content.s.assign(value, length);
+		else *this = PropVal(String(value, length));
+		return *this;
+	}
+
 
 	const Bytes& asBytes() const {
 		if (m_type == Type::BYTES) return *m_content.y;
@@ -426,7 +452,7 @@ public:
 	}
 
 	Array& asArray() {
-		if (m_type == Type::ARRAY) return *m_content.a;
+		if (m_type == Type::ARRAY) return unshared(m_content.a);
 		else throw std::bad_cast();
 	}
 
@@ -437,7 +463,7 @@ public:
 	}
 
 	Props& asProps() {
-		if (m_type == Type::PROPS) return *m_content.o;
+		if (m_type == Type::PROPS) return unshared(m_content.o);
 		else throw std::bad_cast();
 	}
 
@@ -453,19 +479,19 @@ public:
 	using iterator = PropVal*;
 	using const_iterator = const PropVal*;
 
-	iterator begin() noexcept { return m_type == Type::ARRAY ? &*m_content.a->begin() : this; }
+	iterator begin() { return m_type == Type::ARRAY ? unshared(m_content.a).data() : this; }
 	const_iterator begin() const noexcept { return m_type == Type::ARRAY ? &*m_content.a->begin() : this; }
 	const_iterator cbegin() const noexcept { return m_type == Type::ARRAY ? &*m_content.a->cbegin() : this; }
-	iterator end() noexcept { return m_type == Type::ARRAY ? &*m_content.a->end() : this + 1; }
+	iterator end() { return m_type == Type::ARRAY ? unshared(m_content.a).data() + m_content.a->size() : this + 1; }
 	const_iterator end() const noexcept { return m_type == Type::ARRAY ? &*m_content.a->end() : this + 1; }
 	const_iterator cend() const noexcept { return m_type == Type::ARRAY ? &*m_content.a->cend() : this + 1; }
 
 
 	PropVal& operator[](PropKey key) {
-		if (m_type == Type::PROPS) return (*m_content.o)[key];
+		if (m_type == Type::PROPS) return unshared(m_content.o)[key];
 		else if (key.isInteger()) {
 			Integer index = key.asInteger();
-			if (m_type == Type::ARRAY) return (*m_content.a)[index];
+			if (m_type == Type::ARRAY) return unshared(m_content.a)[index];
 			else if (index == 0) return *this;
 			else throw std::out_of_range("PropVal of this type has fixed size 1");
 		}
@@ -474,7 +500,11 @@ public:
 
 
 	const PropVal& operator[](PropKey key) const {
-		if (m_type == Type::PROPS) return (*m_content.o)[key];
+		if (m_type == Type::PROPS) {
+			// Must not insert, content may be shared with other PropVals
+			auto found = m_content.o->find(key);
+			return (found != m_content.o->end()) ? found->second : s_noneValue;
+		}
 		else if (key.isInteger()) {
 			Integer index = key.asInteger();
 			if (m_type == Type::ARRAY) return (*m_content.a)[index];
@@ -487,7 +517,7 @@ public:
 
 	PropVal& operator[](Integer index) {
 		if (m_type == Type::PROPS) return operator[](PropKey(index));
-		else if (m_type == Type::ARRAY) return (*m_content.a)[index];
+		else if (m_type == Type::ARRAY) return unshared(m_content.a)[index];
 		else if (index == 0) return *this;
 		else throw std::out_of_range("PropVal of this type has fixed size 1");
 	}
@@ -503,12 +533,12 @@ public:
 
 	PropVal& at(PropKey key) {
 		if (m_type == Type::PROPS) {
-			PropVal &result = m_content.o->at(key);
+			PropVal &result = unshared(m_content.o).at(key);
 			if (result.isNone()) throw std::out_of_range("PropVal is None");
 			return result;
 		} else if (key.isInteger()) {
 			Integer index = key.asInteger();
-			if (m_type == Type::ARRAY) return m_content.a->at(index);
+			if (m_type == Type::ARRAY) return unshared(m_content.a).at(index);
 			else if (index == 0) return *this;
 			else throw std::out_of_range("PropVal of this type has fixed size 1");
 		}
@@ -518,7 +548,7 @@ public:
 
 	const PropVal& at(PropKey key) const {
 		if (m_type == Type::PROPS) {
-			PropVal &result = m_content.o->at(key);
+			const PropVal &result = m_content.o->at(key);
 			if (result.isNone()) throw std::out_of_range("PropVal is None");
 			return result;
 		} else if (key.isInteger()) {
@@ -533,7 +563,7 @@ public:
 
 	PropVal& at(Integer index) {
 		if (m_type == Type::PROPS) return at(PropKey(index));
-		else if (m_type == Type::ARRAY) return m_content.a->at(index);
+		else if (m_type == Type::ARRAY) return unshared(m_content.a).at(index);
 		else {
 			if (index == 0) return *this;
 			else throw std::out_of_range("PropVal of this type has fixed size 1");
@@ -665,13 +695,47 @@ public:
 	static void toJSON(std::ostream &out, const Array &x);
 	static void toJSON(std::ostream &out, const Props &x);
 
-
+	// Append JSON to a string, much faster than writing to a std::ostream
+	// token by token. Reals use the shortest representation that reads back
+	// to the same value.
+	static void toJSON(std::string &out, None x) { out.append("null"); }
+	static void toJSON(std::string &out, Bool x) { out.append(x ? "true" : "false"); }
+	static void toJSON(std::string &out, Integer x);
+	static void toJSON(std::string &out, Real x);
+	static void toJSON(std::string &out, const Name x);
+	static void toJSON(std::string &out, const Bytes &x);
+	static void toJSON(std::string &out, const String &x) { PropKey::toJSON(out, x); }
+	static void toJSON(std::string &out, const Array &x);
+	static void toJSON(std::string &out, const Props &x);
+
+
+	// Writes via toJSON(std::string&), out receives a single block:
 	void toJSON(std::ostream &out) const;
 	static PropVal fromJSON(std::istream &in);
 
+	// Appends to out, so a buffer can be reused for many values:
+	void toJSON(std::string &out) const;
+
 	std::string toJSON() const;
 	static PropVal fromJSON(const std::string &in);
 
+	// Parses null-terminated JSON in place, modifies the contents of json:
+	static PropVal fromJSONInsitu(char* json);
+
+	// Compact tagged binary encoding, names, integers, reals and bytes are
+	// stored natively (see Props.cxx for the format):
+	void toBinary(std::string &out) const;
+	std::string toBinary() const;
+	static PropVal fromBinary(const char* &pos, const char* end);
+	static PropVal fromBinary(const std::string &in);
+
+	// Binary files start with binaryFileMagic(), followed by one or more
+	// values, each prefixed by its encoded size (uint32, little endian):
+	static const std::string& binaryFileMagic();
+	static void writeBinaryRecord(std::ostream &out, const std::string &encoded);
+	static bool readBinaryRecord(std::istream &in, std::string &encoded);
+
+	// Supported file types: ".json" and ".dbrxb" (binary)
 	void toFile(const std::string &outFileName) const;
 	static PropVal fromFile(const std::string &inFileName);
 
@@ -686,7 +750,7 @@ public:
 	PropVal(const PropVal &other)
 		: m_type(other.m_type), m_content(other.m_type, other.m_content) {}
 
-	PropVal(PropVal &&other) {
+	PropVal(PropVal &&other) noexcept {
 		using namespace std;
 		swap(*this, other);
 	}
@@ -904,9 +968,11 @@ inline std::ostream& operator<<(std::ostream &os, const PropVal &value)
 
 
 
+// Paths of bric components are mostly short (e.g. "app.bric.output"), so up
+// to six elements are stored inline without heap allocation:
 class PropPath final: public virtual Printable {
 public:
-	using Elements = std::vector<PropKey>;
+	using Elements = SmallVector<PropKey, 6>;
 protected:
 	Elements m_elements;
 
@@ -917,7 +983,7 @@ public:
 	class Fragment final: public virtual Printable {
 	public:
 		using const_iterator = typename PropPath::const_iterator;
-		using size_type = typename const_iterator::difference_type;
+		using size_type = typename std::iterator_traits<const_iterator>::difference_type;
 
 	protected:
 		const_iterator m_begin{};
@@ -955,13 +1021,13 @@ public:
 	const_iterator cend() const noexcept { return m_elements.cend(); }
 
 	PropPath& operator%=(PropKey key) {
-		m_elements.reserve(4); // minimum capacity
 		m_elements.push_back(key);
 		return *this;
 	}
 
 	PropPath& operator+=(const PropPath& other) {
-		for (PropKey key: other.m_elements) operator%=(key);
+		m_elements.reserve(m_elements.size() + other.m_elements.size());
+		for (PropKey key: other.m_elements) m_elements.push_back(key);
 		return *this;
 	}
 
@@ -972,13 +1038,15 @@ public:
 	PropPath& operator=(const PropPath& other) = default;
 	PropPath& operator=(PropPath&& other) = default;
 
-	PropPath& operator=(const std::vector<PropKey>& path) { m_elements = path; return *this; }
-	PropPath& operator=(std::vector<PropKey>&& path) { m_elements = std::move(path); return *this; }
+	PropPath& operator=(const std::vector<PropKey>& path) { m_elements.assign(path.begin(), path.end()); return *this; }
 
 	PropPath& operator=(PropKey key) { m_elements.clear(); m_elements.push_back(key); return *this; }
 	PropPath& operator=(Name name) { return *this = PropKey(name); }
 	PropPath& operator=(PropVal::Integer i) { return *this = PropKey(i); }
 
+	// Parsed paths are interned, so frequently used paths (e.g. in
+	// references and connection configs) are only split and converted to
+	// keys once:
 	PropPath& operator=(const std::string& path);
 	PropPath& operator=(const char *path) { return *this = std::string(path); }
 
@@ -987,11 +1055,11 @@ public:
 	PropPath() { }
 
 	PropPath(const PropPath& other) { *this = other; }
-	PropPath(PropPath&& other) { *this = std::move(other); }
+	PropPath(PropPath&& other) noexcept { *this = std::move(other); }
 
 	PropPath(std::initializer_list<PropKey> elements): m_elements(elements.begin(), elements.end()) {}
 
-	PropPath(std::vector<PropKey> path) { *this = std::move(path); }
+	PropPath(const std::vector<PropKey>& path) { *this = path; }
 
 	PropPath(PropKey key) { *this = key; }
 	PropPath(Name name) { *this = name; }
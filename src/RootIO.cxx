@@ -77,7 +77,7 @@ void RootIO::inputValueFrom(WritableValue& value, TTree *tree, const std::string
 }
 
 
-void RootIO::outputValueTo(const Value& value, TTree *tree, const std::string& branchName, Int_t bufsize, Int_t defaultSplitlevel, bool adaptSplitlevel) {
+TBranch* RootIO::outputValueTo(const Value& value, TTree *tree, const std::string& branchName, Int_t bufsize, Int_t defaultSplitlevel, bool adaptSplitlevel) {
 	Int_t splitlevel = defaultSplitlevel;
 
 	if (! value.valid()) throw invalid_argument("Cannot output invalid value object to branch");
@@ -107,6 +107,7 @@ void RootIO::outputValueTo(const Value& value, TTree *tree, const std::string& b
 		branch = tree->Branch(bName, const_cast<void*>(value.untypedPtr()), formatString.c_str(), bufsize);
 	}
 	if (branch == nullptr) throw runtime_error("Failed to create branch");
+	return branch;
 }
 
 
@@ -38,7 +38,7 @@ public:
 
 	// Note: Do *not* change content address for a value of primitive type
 	// while connected to an output branch!
-	static void outputValueTo(const Value& value, TTree *tree, const std::string& branchName, Int_t bufsize = 32000, Int_t defaultSplitlevel = 99, bool adaptSplitlevel = true);
+	static TBranch* outputValueTo(const Value& value, TTree *tree, const std::string& branchName, Int_t bufsize = 32000, Int_t defaultSplitlevel = 99, bool adaptSplitlevel = true);
 };
 
 
@@ -0,0 +1,207 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#ifndef DBRX_SMALLVECTOR_H
+#define DBRX_SMALLVECTOR_H
+
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <initializer_list>
+#include <stdexcept>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+
+
+namespace dbrx {
+
+
+/// @brief Vector with inline storage for up to N elements.
+///
+/// Elements are stored inside the object itself as long as there are no
+/// more than N of them, so short sequences (e.g. paths) need no heap
+/// allocation. Beyond N, elements move to a heap buffer that grows like a
+/// std::vector. Iterators are plain pointers. Moving a SmallVector that
+/// uses inline storage moves the elements one by one.
+
+template<typename T, size_t N> class SmallVector {
+public:
+	using value_type = T;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+	using reference = T&;
+	using const_reference = const T&;
+	using pointer = T*;
+	using const_pointer = const T*;
+	using iterator = T*;
+	using const_iterator = const T*;
+
+protected:
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type m_inline[N > 0 ? N : 1];
+	T* m_data = inlineData();
+	size_type m_size = 0;
+	size_type m_capacity = N;
+
+	T* inlineData() noexcept { return reinterpret_cast<T*>(&m_inline[0]); }
+	bool isInline() const noexcept { return m_data == reinterpret_cast<const T*>(&m_inline[0]); }
+
+	static T* allocate(size_type capacity) { return static_cast<T*>(::operator new(capacity * sizeof(T))); }
+
+	// Moves the elements to newData (allocated via allocate) and takes it over:
+	void relocate(T* newData, size_type newCapacity) {
+		for (size_type i = 0; i < m_size; ++i) {
+			new (newData + i) T(std::move(m_data[i]));
+			m_data[i].~T();
+		}
+		if (! isInline()) ::operator delete(m_data);
+		m_data = newData;
+		m_capacity = newCapacity;
+	}
+
+	void grow(size_type minCapacity) {
+		size_type newCapacity = std::max(minCapacity, 2 * m_capacity);
+		relocate(allocate(newCapacity), newCapacity);
+	}
+
+	// The new element is constructed before the old ones are moved, as the
+	// arguments may refer to elements of this vector:
+	template<typename... Args> T& growAndEmplaceBack(Args&&... args) {
+		size_type newCapacity = std::max(m_size + 1, 2 * m_capacity);
+		T* newData = allocate(newCapacity);
+		T* p = nullptr;
+		try {
+			p = new (newData + m_size) T(std::forward<Args>(args)...);
+		} catch (...) {
+			::operator delete(newData);
+			throw;
+		}
+		relocate(newData, newCapacity);
+		++m_size;
+		return *p;
+	}
+
+	void release() noexcept {
+		clear();
+		if (! isInline()) ::operator delete(m_data);
+		m_data = inlineData();
+		m_capacity = N;
+	}
+
+	// Must only be called with inline storage:
+	void moveFrom(SmallVector &other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+		if (other.isInline()) {
+			for (size_type i = 0; i < other.m_size; ++i) new (m_data + i) T(std::move(other.m_data[i]));
+			m_size = other.m_size;
+			other.clear();
+		} else {
+			m_data = other.m_data;
+			m_size = other.m_size;
+			m_capacity = other.m_capacity;
+			other.m_data = other.inlineData();
+			other.m_size = 0;
+			other.m_capacity = N;
+		}
+	}
+
+public:
+	iterator begin() noexcept { return m_data; }
+	const_iterator begin() const noexcept { return m_data; }
+	const_iterator cbegin() const noexcept { return m_data; }
+	iterator end() noexcept { return m_data + m_size; }
+	const_iterator end() const noexcept { return m_data + m_size; }
+	const_iterator cend() const noexcept { return m_data + m_size; }
+
+	bool empty() const noexcept { return m_size == 0; }
+	size_type size() const noexcept { return m_size; }
+	size_type capacity() const noexcept { return m_capacity; }
+
+	T* data() noexcept { return m_data; }
+	const T* data() const noexcept { return m_data; }
+
+	T& operator[](size_type i) { return m_data[i]; }
+	const T& operator[](size_type i) const { return m_data[i]; }
+
+	T& at(size_type i) { if (i < m_size) return m_data[i]; else throw std::out_of_range("SmallVector index out of range"); }
+	const T& at(size_type i) const { if (i < m_size) return m_data[i]; else throw std::out_of_range("SmallVector index out of range"); }
+
+	T& front() { return m_data[0]; }
+	const T& front() const { return m_data[0]; }
+	T& back() { return m_data[m_size - 1]; }
+	const T& back() const { return m_data[m_size - 1]; }
+
+	void reserve(size_type n) { if (n > m_capacity) grow(n); }
+
+	void clear() noexcept {
+		for (size_type i = 0; i < m_size; ++i) m_data[i].~T();
+		m_size = 0;
+	}
+
+	template<typename... Args> T& emplace_back(Args&&... args) {
+		if (m_size == m_capacity) return growAndEmplaceBack(std::forward<Args>(args)...);
+		T* p = new (m_data + m_size) T(std::forward<Args>(args)...);
+		++m_size;
+		return *p;
+	}
+
+	void push_back(const T &x) { emplace_back(x); }
+	void push_back(T &&x) { emplace_back(std::move(x)); }
+
+	void pop_back() { --m_size; m_data[m_size].~T(); }
+
+	template<typename InputIterator> void assign(InputIterator first, InputIterator last) {
+		clear();
+		for (; first != last; ++first) emplace_back(*first);
+	}
+
+	friend bool operator==(const SmallVector &a, const SmallVector &b) {
+		if (a.size() != b.size()) return false;
+		for (size_type i = 0; i < a.size(); ++i) if (!(a[i] == b[i])) return false;
+		return true;
+	}
+
+	friend bool operator!=(const SmallVector &a, const SmallVector &b) { return ! (a == b); }
+
+	SmallVector& operator=(const SmallVector &other) {
+		if (this != &other) assign(other.begin(), other.end());
+		return *this;
+	}
+
+	SmallVector& operator=(SmallVector &&other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+		if (this != &other) { release(); moveFrom(other); }
+		return *this;
+	}
+
+	SmallVector& operator=(std::initializer_list<T> init) { assign(init.begin(), init.end()); return *this; }
+
+	SmallVector() {}
+
+	SmallVector(const SmallVector &other) { reserve(other.size()); assign(other.begin(), other.end()); }
+	SmallVector(SmallVector &&other) noexcept(std::is_nothrow_move_constructible<T>::value) { moveFrom(other); }
+
+	SmallVector(std::initializer_list<T> init) { reserve(init.size()); assign(init.begin(), init.end()); }
+
+	template<typename InputIterator> SmallVector(InputIterator first, InputIterator last) { assign(first, last); }
+
+	~SmallVector() { release(); }
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_SMALLVECTOR_H
@@ -84,6 +84,10 @@ public:
 
 	virtual void fromPropVal(const PropVal &p) = 0;
 
+	// Copies content of source, which must have the same content type. For
+	// values of primitive type, the content address is not changed.
+	virtual void assign(const Value &source) = 0;
+
 	friend void swap(WritableValue &a, WritableValue &b)
 		{ std::swap(*a.untypedPPtr(), *b.untypedPPtr()); }
 };
@@ -154,6 +158,12 @@ protected:
 	template <typename U> static auto assignFromPropVal(U& x, const PropVal &p, PropValConvSpecial) -> decltype(assign_from(x, p)) { assign_from(x, p); }
 	static void assignFromPropVal(T &x, const PropVal &p, PropValConvGeneral) { throw std::invalid_argument("No conversion from PropVal to content type of this Value available"); }
 
+	// SFINAE-based default implementation if T is not copy-assignable.
+	struct CopyGeneral {};
+	struct CopySpecial : CopyGeneral {};
+	template <typename U> static auto copyAssign(U& x, const U& y, CopySpecial) -> decltype(x = y, void()) { x = y; }
+	static void copyAssign(T &x, const T &y, CopyGeneral) { throw std::invalid_argument("Content type of this Value is not copy-assignable"); }
+
 public:
 	virtual operator T& () = 0;
 	virtual T* operator->() = 0;
@@ -199,6 +209,15 @@ public:
 	void fromPropVal(const PropVal &p) final override
 		{ assignFromPropVal(get(), p, PropValConvSpecial()); }
 
+	void assign(const Value &source) final override {
+		const T* src = source.typedPtr<T>();
+		if (src == nullptr) clear();
+		else {
+			if (ptr() == nullptr) setToDefault();
+			copyAssign(get(), *src, CopySpecial());
+		}
+	}
+
 	friend void swap(TypedWritableValue &a, TypedWritableValue &b)
 		{ swap(static_cast<WritableValue &>(a), static_cast<WritableValue &>(b)); }
 };
@@ -0,0 +1,193 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "binarybrics.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "logging.h"
+#include "TypeReflection.h"
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+template<typename T> class BinaryRecordReader::Fields::TypedField final: public Field {
+public:
+	size_t alignment() const override { return alignof(T); }
+
+	void setDirect(bool direct) override {
+		m_direct = direct;
+		// Direct fields must not own a value, they will point into the records:
+		if (m_direct) m_terminal.value().clear();
+		else if (m_terminal.value().empty()) m_terminal.value().setToDefault();
+	}
+
+	void setRecord(const char* record) override {
+		if (m_direct) {
+			*m_terminal.value().untypedPPtr() = const_cast<char*>(record + m_offset);
+		} else {
+			char *target = reinterpret_cast<char*>(m_terminal.value().typedPtr<T>());
+			memcpy(target, record + m_offset, sizeof(T));
+			if (m_swapBytes) reverse(target, target + sizeof(T));
+		}
+	}
+
+	void release() override {
+		if (m_direct) m_terminal.value().untypedRelease();
+	}
+
+	TypedField(OutputTerminal& terminal, size_t offset, bool swapBytes)
+		: Field(terminal, offset, swapBytes)
+	{
+		if (terminal.value().typeInfo() != typeid(T))
+			throw invalid_argument("Output \"%s\" has type %s, doesn't match field type %s"_format(terminal.absolutePath(), TypeReflection(terminal.value().typeInfo()).name(), TypeReflection(typeid(T)).name()));
+	}
+};
+
+
+std::unique_ptr<BinaryRecordReader::Fields::Field> BinaryRecordReader::Fields::newField(OutputTerminal& terminal, const std::string &typeName, size_t offset, bool swapBytes) {
+	if (typeName == "int8") return unique_ptr<Field>(new TypedField<int8_t>(terminal, offset, swapBytes));
+	else if (typeName == "uint8") return unique_ptr<Field>(new TypedField<uint8_t>(terminal, offset, swapBytes));
+	else if (typeName == "int16") return unique_ptr<Field>(new TypedField<int16_t>(terminal, offset, swapBytes));
+	else if (typeName == "uint16") return unique_ptr<Field>(new TypedField<uint16_t>(terminal, offset, swapBytes));
+	else if (typeName == "int32") return unique_ptr<Field>(new TypedField<int32_t>(terminal, offset, swapBytes));
+	else if (typeName == "uint32") return unique_ptr<Field>(new TypedField<uint32_t>(terminal, offset, swapBytes));
+	else if (typeName == "int64") return unique_ptr<Field>(new TypedField<int64_t>(terminal, offset, swapBytes));
+	else if (typeName == "uint64") return unique_ptr<Field>(new TypedField<uint64_t>(terminal, offset, swapBytes));
+	else if (typeName == "float") return unique_ptr<Field>(new TypedField<float>(terminal, offset, swapBytes));
+	else if (typeName == "double") return unique_ptr<Field>(new TypedField<double>(terminal, offset, swapBytes));
+	else throw invalid_argument("Unsupported type \"%s\" for field \"%s\""_format(typeName, terminal.absolutePath()));
+}
+
+
+void BinaryRecordReader::Fields::connectFields(const PropVal &layout, const std::string &defaultByteOrder, size_t headerSize, size_t recordSize) {
+	releaseFields();
+
+	for (auto &elem: m_outputs) {
+		OutputTerminal *terminal = elem.second;
+		if (!layout.contains(terminal->name()))
+			throw invalid_argument("Field \"%s\" not found in record layout of \"%s\""_format(terminal->name(), absolutePath()));
+		const PropVal &spec = layout[terminal->name()];
+
+		string fieldByteOrder = spec.contains("byteOrder") ? spec["byteOrder"].asString() : defaultByteOrder;
+		if ((fieldByteOrder != "little") && (fieldByteOrder != "big"))
+			throw invalid_argument("Invalid byte order \"%s\" for field \"%s\""_format(fieldByteOrder, terminal->absolutePath()));
+		bool swapBytes = (fieldByteOrder == "big") != hostIsBigEndian();
+
+		unique_ptr<Field> field = newField(*terminal, spec["type"].asString(), size_t(spec["offset"].asLong64()), swapBytes);
+
+		// Mapping starts at a page boundary, so alignment within the file
+		// is sufficient for direct access:
+		size_t align = field->alignment();
+		bool direct = !swapBytes && ((headerSize + field->offset()) % align == 0) && (recordSize % align == 0);
+		field->setDirect(direct);
+		dbrx_log_debug("Connecting record field \"%s\" at offset %s in \"%s\" (%s)", terminal->name(), field->offset(), absolutePath(), direct ? "direct" : "decoded");
+
+		m_fields.push_back(std::move(field));
+	}
+}
+
+
+void BinaryRecordReader::Fields::releaseFields() {
+	for (auto &field: m_fields) field->release();
+	m_fields.clear();
+}
+
+
+void BinaryRecordReader::Fields::setRecord(const char* record) {
+	for (auto &field: m_fields) field->setRecord(record);
+}
+
+
+BinaryRecordReader::Fields::~Fields() {
+	releaseFields();
+}
+
+
+size_t BinaryRecordReader::fieldTypeSize(const std::string &typeName) {
+	if ((typeName == "int8") || (typeName == "uint8")) return 1;
+	else if ((typeName == "int16") || (typeName == "uint16")) return 2;
+	else if ((typeName == "int32") || (typeName == "uint32") || (typeName == "float")) return 4;
+	else if ((typeName == "int64") || (typeName == "uint64") || (typeName == "double")) return 8;
+	else throw invalid_argument("Unsupported record field type \"%s\""_format(typeName));
+}
+
+
+bool BinaryRecordReader::hostIsBigEndian() {
+	const uint16_t x = 1;
+	return *reinterpret_cast<const uint8_t*>(&x) == 0;
+}
+
+
+size_t BinaryRecordReader::layoutRecordSize() {
+	size_t result = 0;
+	for (const auto &entry: layout->asProps()) {
+		const PropVal &spec = entry.second;
+		int64_t offset = spec["offset"].asLong64();
+		if (offset < 0) throw invalid_argument("Negative offset for field \"%s\" in bric \"%s\""_format(entry.first, absolutePath()));
+		result = max(result, size_t(offset) + fieldTypeSize(spec["type"].asString()));
+	}
+	return result;
+}
+
+
+void BinaryRecordReader::processInput() {
+	fields.releaseFields();
+	m_file.close();
+
+	size_t layoutSize = layoutRecordSize();
+	m_recordSize = (recordSize > 0) ? size_t(recordSize.get()) : layoutSize;
+	if (m_recordSize == 0) throw invalid_argument("Empty record layout in bric \"%s\""_format(absolutePath()));
+	if (m_recordSize < layoutSize)
+		throw invalid_argument("Record size %s is smaller than record layout (%s bytes) in bric \"%s\""_format(m_recordSize, layoutSize, absolutePath()));
+
+	dbrx_log_debug("Opening binary record file \"%s\" in bric \"%s\""_format(input.get(), absolutePath()));
+	m_file.open(input);
+	size_t skip = size_t(headerSize.get());
+	if (skip > m_file.size())
+		throw runtime_error("File \"%s\" is smaller than header size %s"_format(m_file.fileName(), skip));
+
+	size_t dataSize = m_file.size() - skip;
+	if (dataSize % m_recordSize != 0)
+		dbrx_log_warn("Size of file \"%s\" is not a multiple of record size %s, ignoring %s trailing bytes", m_file.fileName(), m_recordSize, dataSize % m_recordSize);
+
+	m_records = m_file.data() + skip;
+	m_file.advise(MappedFile::Advice::Sequential);
+
+	fields.connectFields(layout, byteOrder, skip, m_recordSize);
+
+	size = ssize_t(dataSize / m_recordSize);
+	index = -1;
+}
+
+
+bool BinaryRecordReader::nextOutput() {
+	if (index.get() + 1 >= size.get()) return false;
+
+	++index;
+	fields.setRecord(m_records + size_t(index.get()) * m_recordSize);
+	return true;
+}
+
+
+} // namespace dbrx
@@ -0,0 +1,110 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_BINARYBRICS_H
+#define DBRX_BINARYBRICS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bric.h"
+#include "MappedFile.h"
+
+
+namespace dbrx {
+
+
+class BinaryRecordReader: public MapperBric {
+protected:
+	MappedFile m_file;
+	const char* m_records = nullptr;
+	size_t m_recordSize = 0;
+
+	static size_t fieldTypeSize(const std::string &typeName);
+	static bool hostIsBigEndian();
+
+	// Size of the records according to the layout (end of the last field)
+	virtual size_t layoutRecordSize();
+
+public:
+	class Fields final: public DynOutputGroup {
+	protected:
+		// Exposes one field of the current record on an output terminal
+		class Field {
+		protected:
+			OutputTerminal& m_terminal;
+			size_t m_offset;
+			bool m_swapBytes;
+			bool m_direct = false;
+
+		public:
+			// Fields without byte swapping and with suitable alignment point
+			// directly into the record, others are decoded into a value.
+			virtual void setDirect(bool direct) = 0;
+			virtual size_t alignment() const = 0;
+
+			size_t offset() const { return m_offset; }
+			bool swapBytes() const { return m_swapBytes; }
+
+			virtual void setRecord(const char* record) = 0;
+			virtual void release() = 0;
+
+			Field(OutputTerminal& terminal, size_t offset, bool swapBytes)
+				: m_terminal(terminal), m_offset(offset), m_swapBytes(swapBytes) {}
+			virtual ~Field() {}
+		};
+
+		template<typename T> class TypedField;
+
+		std::vector< std::unique_ptr<Field> > m_fields;
+
+		static std::unique_ptr<Field> newField(OutputTerminal& terminal, const std::string &typeName, size_t offset, bool swapBytes);
+
+	public:
+		void connectFields(const PropVal &layout, const std::string &defaultByteOrder, size_t headerSize, size_t recordSize);
+		void releaseFields();
+
+		void setRecord(const char* record);
+
+		using DynOutputGroup::DynOutputGroup;
+		~Fields();
+	};
+
+	Input<std::string> input{this, "", "Input File Name"};
+
+	Param<PropVal> layout{this, "layout", "Record layout by field name, e.g. {\"energy\": {\"type\": \"float\", \"offset\": 4, \"byteOrder\": \"big\"}}, types int8 to uint64, float and double", Props()};
+	Param<std::string> byteOrder{this, "byteOrder", "Default byte order of fields, \"little\" or \"big\"", "little"};
+	Param<int64_t> recordSize{this, "recordSize", "Record size in bytes (0 for end of last field in layout)", 0};
+	Param<int64_t> headerSize{this, "headerSize", "Number of bytes to skip at start of file", 0};
+
+	Fields fields{this, "fields"};
+
+	Output<ssize_t> size{this, "size", "Number of records"};
+	Output<ssize_t> index{this, "index", "Index of current record"};
+
+	void processInput() override;
+
+	bool nextOutput() override;
+
+	using MapperBric::MapperBric;
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_BINARYBRICS_H
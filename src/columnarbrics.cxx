@@ -0,0 +1,665 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "columnarbrics.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <RVersion.h>
+#include <RZip.h>
+#include <Compression.h>
+
+#include "logging.h"
+#include "TypeReflection.h"
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+namespace {
+
+template<typename T> void appendPOD(vector<char> &buffer, const T &x) {
+	const char *p = reinterpret_cast<const char*>(&x);
+	buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+
+template<typename T> T readPOD(const char *&pos, const char *end) {
+	if (size_t(end - pos) < sizeof(T)) throw runtime_error("Unexpected end of columnar file footer");
+	T x;
+	memcpy(&x, pos, sizeof(T));
+	pos += sizeof(T);
+	return x;
+}
+
+} // namespace
+
+
+
+const char ColumnarFormat::s_magic[8] = {'D', 'B', 'R', 'X', 'C', 'O', 'L', '1'};
+const uint32_t ColumnarFormat::s_version;
+const size_t ColumnarFormat::s_alignment;
+
+
+uint8_t ColumnarFormat::typeCode(const std::type_info &type) {
+	if (type == typeid(bool)) return kBool;
+	else if (type == typeid(int8_t)) return kInt8;
+	else if (type == typeid(uint8_t)) return kUInt8;
+	else if (type == typeid(int16_t)) return kInt16;
+	else if (type == typeid(uint16_t)) return kUInt16;
+	else if (type == typeid(int32_t)) return kInt32;
+	else if (type == typeid(uint32_t)) return kUInt32;
+	else if (type == typeid(int64_t)) return kInt64;
+	else if (type == typeid(uint64_t)) return kUInt64;
+	else if (type == typeid(float)) return kFloat;
+	else if (type == typeid(double)) return kDouble;
+	else if (type == typeid(std::string)) return kString;
+	else if (type == typeid(std::vector<int8_t>)) return kVector | kInt8;
+	else if (type == typeid(std::vector<uint8_t>)) return kVector | kUInt8;
+	else if (type == typeid(std::vector<int16_t>)) return kVector | kInt16;
+	else if (type == typeid(std::vector<uint16_t>)) return kVector | kUInt16;
+	else if (type == typeid(std::vector<int32_t>)) return kVector | kInt32;
+	else if (type == typeid(std::vector<uint32_t>)) return kVector | kUInt32;
+	else if (type == typeid(std::vector<int64_t>)) return kVector | kInt64;
+	else if (type == typeid(std::vector<uint64_t>)) return kVector | kUInt64;
+	else if (type == typeid(std::vector<float>)) return kVector | kFloat;
+	else if (type == typeid(std::vector<double>)) return kVector | kDouble;
+	else return 0;
+}
+
+
+std::string ColumnarFormat::typeName(uint8_t code) {
+	switch (code & ~kVector) {
+		case kBool: return (code & kVector) ? "invalid" : "bool";
+		case kInt8: return (code & kVector) ? "std::vector<int8_t>" : "int8_t";
+		case kUInt8: return (code & kVector) ? "std::vector<uint8_t>" : "uint8_t";
+		case kInt16: return (code & kVector) ? "std::vector<int16_t>" : "int16_t";
+		case kUInt16: return (code & kVector) ? "std::vector<uint16_t>" : "uint16_t";
+		case kInt32: return (code & kVector) ? "std::vector<int32_t>" : "int32_t";
+		case kUInt32: return (code & kVector) ? "std::vector<uint32_t>" : "uint32_t";
+		case kInt64: return (code & kVector) ? "std::vector<int64_t>" : "int64_t";
+		case kUInt64: return (code & kVector) ? "std::vector<uint64_t>" : "uint64_t";
+		case kFloat: return (code & kVector) ? "std::vector<float>" : "float";
+		case kDouble: return (code & kVector) ? "std::vector<double>" : "double";
+		case kString: return (code & kVector) ? "invalid" : "std::string";
+		default: return "invalid";
+	}
+}
+
+
+size_t ColumnarFormat::elementSize(uint8_t code) {
+	switch (code & ~kVector) {
+		case kBool: return sizeof(bool);
+		case kInt8: case kUInt8: return 1;
+		case kInt16: case kUInt16: return 2;
+		case kInt32: case kUInt32: case kFloat: return 4;
+		case kInt64: case kUInt64: case kDouble: return 8;
+		case kString: return 1;
+		default: throw invalid_argument("Invalid columnar type code %s"_format(int(code)));
+	}
+}
+
+
+void ColumnarFormat::compress(const char *src, size_t size, std::vector<char> &compressed, int level) {
+	compressed.clear();
+	#if ROOT_VERSION_CODE >= ROOT_VERSION(6,12,0)
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,20,0)
+			const auto algorithm = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+		#else
+			const auto algorithm = ROOT::kLZ4;
+		#endif
+
+		// R__zip handles at most 2^24 - 1 bytes per call, so compress
+		// piece-wise. Target space is limited to the source size, R__zip
+		// fails if the data is incompressible:
+		const size_t maxPieceSize = 0xffffff;
+		size_t pos = 0;
+		while (pos < size) {
+			int srcSize = int(min(size - pos, maxPieceSize));
+			int tgtSize = srcSize;
+			size_t outPos = compressed.size();
+			compressed.resize(outPos + size_t(tgtSize));
+			int irep = 0;
+			R__zipMultipleAlgorithm(level, &srcSize, const_cast<char*>(src + pos), &tgtSize, compressed.data() + outPos, &irep, algorithm);
+			if (irep <= 0) { compressed.clear(); return; }
+			compressed.resize(outPos + size_t(irep));
+			pos += size_t(srcSize);
+		}
+	#else
+		throw runtime_error("LZ4 compression of columnar files requires ROOT >= 6.12");
+	#endif
+}
+
+
+void ColumnarFormat::decompress(const char *src, size_t size, char *target, size_t rawSize) {
+	size_t inPos = 0, outPos = 0;
+	while (inPos < size) {
+		unsigned char *piece = reinterpret_cast<unsigned char*>(const_cast<char*>(src + inPos));
+		int pieceSize = 0, pieceRawSize = 0;
+		if ((size - inPos < 9) || (R__unzip_header(&pieceSize, piece, &pieceRawSize) != 0))
+			throw runtime_error("Invalid compressed chunk in columnar file");
+		if ((inPos + size_t(pieceSize) > size) || (outPos + size_t(pieceRawSize) > rawSize))
+			throw runtime_error("Compressed chunk in columnar file exceeds its bounds");
+
+		int irep = 0;
+		R__unzip(&pieceSize, piece, &pieceRawSize, reinterpret_cast<unsigned char*>(target + outPos), &irep);
+		if (irep != pieceRawSize) throw runtime_error("Failed to decompress chunk in columnar file");
+
+		inPos += size_t(pieceSize);
+		outPos += size_t(pieceRawSize);
+	}
+	if (outPos != rawSize) throw runtime_error("Decompressed chunk in columnar file has wrong size");
+}
+
+
+
+template<typename T> class ColumnarFileWriter::FixedColumn final: public Column {
+protected:
+	std::vector<char> m_data;
+
+public:
+	uint8_t typeCode() const override { return ColumnarFormat::typeCode(typeid(T)); }
+
+	void append() override {
+		const T* x = m_value.typedPtr<T>();
+		if (x == nullptr) throw runtime_error("Empty input value for column \"%s\""_format(m_name));
+		appendPOD(m_data, *x);
+	}
+
+	void takeChunk(std::vector<char> &data) override {
+		data.insert(data.end(), m_data.begin(), m_data.end());
+		m_data.clear();
+	}
+
+	using Column::Column;
+};
+
+
+class ColumnarFileWriter::StringColumn final: public Column {
+protected:
+	std::vector<uint64_t> m_offsets{0};
+	std::vector<char> m_data;
+
+public:
+	uint8_t typeCode() const override { return ColumnarFormat::kString; }
+
+	void append() override {
+		const std::string* x = m_value.typedPtr<std::string>();
+		if (x == nullptr) throw runtime_error("Empty input value for column \"%s\""_format(m_name));
+		m_data.insert(m_data.end(), x->begin(), x->end());
+		m_offsets.push_back(m_data.size());
+	}
+
+	void takeChunk(std::vector<char> &data) override {
+		for (uint64_t offset: m_offsets) appendPOD(data, offset);
+		data.insert(data.end(), m_data.begin(), m_data.end());
+		m_offsets.assign(1, 0);
+		m_data.clear();
+	}
+
+	using Column::Column;
+};
+
+
+template<typename T> class ColumnarFileWriter::VectorColumn final: public Column {
+protected:
+	std::vector<uint64_t> m_offsets{0};
+	std::vector<char> m_data;
+
+public:
+	uint8_t typeCode() const override { return ColumnarFormat::typeCode(typeid(std::vector<T>)); }
+
+	void append() override {
+		const std::vector<T>* x = m_value.typedPtr< std::vector<T> >();
+		if (x == nullptr) throw runtime_error("Empty input value for column \"%s\""_format(m_name));
+		const char *p = reinterpret_cast<const char*>(x->data());
+		m_data.insert(m_data.end(), p, p + x->size() * sizeof(T));
+		m_offsets.push_back(m_data.size());
+	}
+
+	void takeChunk(std::vector<char> &data) override {
+		for (uint64_t offset: m_offsets) appendPOD(data, offset);
+		data.insert(data.end(), m_data.begin(), m_data.end());
+		m_offsets.assign(1, 0);
+		m_data.clear();
+	}
+
+	using Column::Column;
+};
+
+
+std::unique_ptr<ColumnarFileWriter::Column> ColumnarFileWriter::newColumn(const std::string &name, const Value& value) {
+	switch (ColumnarFormat::typeCode(value.typeInfo())) {
+		case ColumnarFormat::kBool: return unique_ptr<Column>(new FixedColumn<bool>(name, value));
+		case ColumnarFormat::kInt8: return unique_ptr<Column>(new FixedColumn<int8_t>(name, value));
+		case ColumnarFormat::kUInt8: return unique_ptr<Column>(new FixedColumn<uint8_t>(name, value));
+		case ColumnarFormat::kInt16: return unique_ptr<Column>(new FixedColumn<int16_t>(name, value));
+		case ColumnarFormat::kUInt16: return unique_ptr<Column>(new FixedColumn<uint16_t>(name, value));
+		case ColumnarFormat::kInt32: return unique_ptr<Column>(new FixedColumn<int32_t>(name, value));
+		case ColumnarFormat::kUInt32: return unique_ptr<Column>(new FixedColumn<uint32_t>(name, value));
+		case ColumnarFormat::kInt64: return unique_ptr<Column>(new FixedColumn<int64_t>(name, value));
+		case ColumnarFormat::kUInt64: return unique_ptr<Column>(new FixedColumn<uint64_t>(name, value));
+		case ColumnarFormat::kFloat: return unique_ptr<Column>(new FixedColumn<float>(name, value));
+		case ColumnarFormat::kDouble: return unique_ptr<Column>(new FixedColumn<double>(name, value));
+		case ColumnarFormat::kString: return unique_ptr<Column>(new StringColumn(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt8: return unique_ptr<Column>(new VectorColumn<int8_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt8: return unique_ptr<Column>(new VectorColumn<uint8_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt16: return unique_ptr<Column>(new VectorColumn<int16_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt16: return unique_ptr<Column>(new VectorColumn<uint16_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt32: return unique_ptr<Column>(new VectorColumn<int32_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt32: return unique_ptr<Column>(new VectorColumn<uint32_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt64: return unique_ptr<Column>(new VectorColumn<int64_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt64: return unique_ptr<Column>(new VectorColumn<uint64_t>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kFloat: return unique_ptr<Column>(new VectorColumn<float>(name, value));
+		case ColumnarFormat::kVector | ColumnarFormat::kDouble: return unique_ptr<Column>(new VectorColumn<double>(name, value));
+		default: throw invalid_argument("Input \"%s\" has unsupported type %s for columnar output"_format(name, TypeReflection(value.typeInfo()).name()));
+	}
+}
+
+
+void ColumnarFileWriter::writeData(const char *data, size_t size) {
+	m_output.write(data, size);
+	if (!m_output) throw runtime_error("Failed to write to columnar file \"%s\""_format(fileName.get()));
+	m_outputPos += size;
+}
+
+
+void ColumnarFileWriter::writeBlock() {
+	if (m_blockFill == 0) return;
+
+	static const char padding[ColumnarFormat::s_alignment] = {};
+
+	m_blockEntries.push_back(m_blockFill);
+	for (auto &column: m_columns) {
+		m_chunkData.clear();
+		column->takeChunk(m_chunkData);
+
+		ColumnarFormat::ChunkInfo chunk;
+		chunk.offset = m_outputPos;
+		chunk.rawSize = m_chunkData.size();
+
+		if (lz4) ColumnarFormat::compress(m_chunkData.data(), m_chunkData.size(), m_compressed, compressionLevel);
+		if (lz4 && !m_compressed.empty() && (m_compressed.size() < m_chunkData.size())) {
+			chunk.storedSize = m_compressed.size();
+			writeData(m_compressed.data(), m_compressed.size());
+		} else {
+			chunk.storedSize = m_chunkData.size();
+			writeData(m_chunkData.data(), m_chunkData.size());
+		}
+		writeData(padding, (ColumnarFormat::s_alignment - m_outputPos % ColumnarFormat::s_alignment) % ColumnarFormat::s_alignment);
+
+		m_chunks.push_back(chunk);
+	}
+	m_blockFill = 0;
+}
+
+
+void ColumnarFileWriter::writeFooter() {
+	uint64_t footerOffset = m_outputPos;
+
+	vector<char> footer;
+	appendPOD(footer, uint32_t(m_columns.size()));
+	for (const auto &column: m_columns) {
+		appendPOD(footer, column->typeCode());
+		appendPOD(footer, uint32_t(column->name().size()));
+		footer.insert(footer.end(), column->name().begin(), column->name().end());
+	}
+
+	appendPOD(footer, uint64_t(m_blockEntries.size()));
+	auto chunk = m_chunks.begin();
+	for (uint64_t nEntries: m_blockEntries) {
+		appendPOD(footer, nEntries);
+		for (size_t i = 0; i < m_columns.size(); ++i, ++chunk) {
+			appendPOD(footer, chunk->offset);
+			appendPOD(footer, chunk->storedSize);
+			appendPOD(footer, chunk->rawSize);
+		}
+	}
+
+	appendPOD(footer, footerOffset);
+	footer.insert(footer.end(), ColumnarFormat::s_magic, ColumnarFormat::s_magic + sizeof(ColumnarFormat::s_magic));
+
+	writeData(footer.data(), footer.size());
+}
+
+
+void ColumnarFileWriter::newReduction() {
+	if (blockSize <= 0) throw invalid_argument("Block size must be positive in bric \"%s\""_format(absolutePath()));
+
+	m_columns.clear();
+	for (const auto &in: entry.columnInputs())
+		m_columns.push_back(newColumn(in.first, in.second->value()));
+
+	dbrx_log_debug("Creating columnar file \"%s\" with %s columns in bric \"%s\""_format(fileName.get(), m_columns.size(), absolutePath()));
+	m_output.close();
+	m_output.clear();
+	m_output.open(fileName->c_str(), ios::binary | ios::trunc);
+	if (!m_output) throw runtime_error("Could not create columnar file \"%s\""_format(fileName.get()));
+
+	m_outputPos = 0;
+	m_blockFill = 0;
+	m_blockEntries.clear();
+	m_chunks.clear();
+
+	vector<char> header(ColumnarFormat::s_magic, ColumnarFormat::s_magic + sizeof(ColumnarFormat::s_magic));
+	appendPOD(header, ColumnarFormat::s_version);
+	appendPOD(header, uint32_t(0));
+	writeData(header.data(), header.size());
+
+	size = 0;
+}
+
+
+void ColumnarFileWriter::processInput() {
+	for (auto &column: m_columns) column->append();
+	++size;
+	if (++m_blockFill >= size_t(blockSize.get())) writeBlock();
+}
+
+
+void ColumnarFileWriter::finalizeReduction() {
+	writeBlock();
+	writeFooter();
+	m_output.close();
+	if (!m_output) throw runtime_error("Failed to close columnar file \"%s\""_format(fileName.get()));
+
+	dbrx_log_debug("Wrote %s entries in %s blocks to columnar file \"%s\" in bric \"%s\""_format(size.get(), m_blockEntries.size(), fileName.get(), absolutePath()));
+	output = fileName;
+	m_columns.clear();
+}
+
+
+void ColumnarFileWriter::Entry::applyConfig(const PropVal& config) {
+	Props configProps = config.asProps();
+	m_inputSources.clear(); m_inputSources.reserve(configProps.size());
+	for (const auto &e: config.asProps())
+		m_inputSources.push_back({e.first, BCReference(e.second).path()});
+}
+
+
+PropVal ColumnarFileWriter::Entry::getConfig() const {
+	Props configProps;
+	for (const auto &col: m_inputSources) configProps[col.first] = BCReference(col.second);
+	return PropVal(std::move(configProps));
+}
+
+
+void ColumnarFileWriter::Entry::connectInputs() {
+	dbrx_log_trace("Creating and connecting dynamic inputs of bric \"%s\"", absolutePath());
+	if (m_inputsConnected) throw logic_error("Can't connect already connected inputs in bric \"%s\""_format(absolutePath()));
+
+	for (const auto &col: m_inputSources)
+		connectInputToSiblingOrUp(*this, col.first, col.second);
+}
+
+
+void ColumnarFileWriter::Entry::disconnectInputs() {
+	m_dynBrics.clear();
+}
+
+
+std::vector< std::pair<std::string, const Bric::InputTerminal*> > ColumnarFileWriter::Entry::columnInputs() const {
+	std::map<std::string, const InputTerminal*> sortedInputs;
+	for (const auto &in: inputs()) sortedInputs[in.first.toString()] = in.second;
+	return std::vector< std::pair<std::string, const InputTerminal*> >(sortedInputs.begin(), sortedInputs.end());
+}
+
+
+
+void ColumnarFileReader::Entry::Column::loadChunk(const MappedFile &file, const ColumnarFormat::ChunkInfo &chunk, uint64_t nEntries) {
+	if ((chunk.offset > file.size()) || (chunk.storedSize > file.size() - chunk.offset))
+		throw runtime_error("Chunk of output \"%s\" exceeds size of columnar file \"%s\""_format(m_terminal.absolutePath(), file.fileName()));
+
+	const char *stored = file.data() + chunk.offset;
+	if (chunk.compressed()) {
+		m_decompressed.resize(chunk.rawSize);
+		ColumnarFormat::decompress(stored, chunk.storedSize, m_decompressed.data(), chunk.rawSize);
+		m_chunk = m_decompressed.data();
+	} else {
+		m_chunk = stored;
+	}
+	m_nEntries = nEntries;
+
+	uint64_t minSize = ColumnarFormat::isVariableLength(m_typeCode) ?
+		(nEntries + 1) * sizeof(uint64_t) :
+		nEntries * ColumnarFormat::elementSize(m_typeCode);
+	bool valid = chunk.rawSize >= minSize;
+	if (valid && ColumnarFormat::isVariableLength(m_typeCode)) {
+		uint64_t dataSize = chunk.rawSize - minSize;
+		uint64_t dataEnd = 0;
+		memcpy(&dataEnd, m_chunk + nEntries * sizeof(uint64_t), sizeof(uint64_t));
+		valid = dataEnd <= dataSize;
+	}
+	if (!valid) throw runtime_error("Invalid chunk of output \"%s\" in columnar file \"%s\""_format(m_terminal.absolutePath(), file.fileName()));
+}
+
+
+template<typename T> class ColumnarFileReader::Entry::FixedColumn final: public Column {
+public:
+	void setEntry(uint64_t i) override {
+		// Zero-copy, output refers to the value inside the chunk:
+		*m_terminal.value().untypedPPtr() = const_cast<char*>(m_chunk + i * sizeof(T));
+	}
+
+	void release() override {
+		m_terminal.value().untypedRelease();
+	}
+
+	FixedColumn(OutputTerminal& terminal, size_t columnIndex, uint8_t typeCode)
+		: Column(terminal, columnIndex, typeCode)
+	{
+		// Output value must not own anything, will point into chunks:
+		m_terminal.value().clear();
+	}
+};
+
+
+class ColumnarFileReader::Entry::StringColumn final: public Column {
+public:
+	void setEntry(uint64_t i) override {
+		const uint64_t *offsets = reinterpret_cast<const uint64_t*>(m_chunk);
+		const char *data = m_chunk + (m_nEntries + 1) * sizeof(uint64_t);
+		if (offsets[i] > offsets[i + 1]) throw runtime_error("Invalid string offsets for output \"%s\""_format(m_terminal.absolutePath()));
+		if (m_terminal.value().empty()) m_terminal.value().setToDefault();
+		m_terminal.value().typedPtr<std::string>()->assign(data + offsets[i], offsets[i + 1] - offsets[i]);
+	}
+
+	using Column::Column;
+};
+
+
+template<typename T> class ColumnarFileReader::Entry::VectorColumn final: public Column {
+public:
+	void setEntry(uint64_t i) override {
+		const uint64_t *offsets = reinterpret_cast<const uint64_t*>(m_chunk);
+		const char *data = m_chunk + (m_nEntries + 1) * sizeof(uint64_t);
+		if ((offsets[i] > offsets[i + 1]) || (offsets[i] % sizeof(T) != 0) || (offsets[i + 1] % sizeof(T) != 0))
+			throw runtime_error("Invalid vector offsets for output \"%s\""_format(m_terminal.absolutePath()));
+		if (m_terminal.value().empty()) m_terminal.value().setToDefault();
+		const T *from = reinterpret_cast<const T*>(data + offsets[i]);
+		const T *until = reinterpret_cast<const T*>(data + offsets[i + 1]);
+		m_terminal.value().typedPtr< std::vector<T> >()->assign(from, until);
+	}
+
+	using Column::Column;
+};
+
+
+std::unique_ptr<ColumnarFileReader::Entry::Column> ColumnarFileReader::Entry::newColumn(OutputTerminal& terminal, size_t columnIndex, uint8_t typeCode) {
+	uint8_t outputTypeCode = ColumnarFormat::typeCode(terminal.value().typeInfo());
+	if (outputTypeCode != typeCode)
+		throw invalid_argument("Output \"%s\" has type %s, but column has type %s"_format(terminal.absolutePath(), TypeReflection(terminal.value().typeInfo()).name(), ColumnarFormat::typeName(typeCode)));
+
+	switch (typeCode) {
+		case ColumnarFormat::kBool: return unique_ptr<Column>(new FixedColumn<bool>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kInt8: return unique_ptr<Column>(new FixedColumn<int8_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kUInt8: return unique_ptr<Column>(new FixedColumn<uint8_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kInt16: return unique_ptr<Column>(new FixedColumn<int16_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kUInt16: return unique_ptr<Column>(new FixedColumn<uint16_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kInt32: return unique_ptr<Column>(new FixedColumn<int32_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kUInt32: return unique_ptr<Column>(new FixedColumn<uint32_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kInt64: return unique_ptr<Column>(new FixedColumn<int64_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kUInt64: return unique_ptr<Column>(new FixedColumn<uint64_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kFloat: return unique_ptr<Column>(new FixedColumn<float>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kDouble: return unique_ptr<Column>(new FixedColumn<double>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kString: return unique_ptr<Column>(new StringColumn(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt8: return unique_ptr<Column>(new VectorColumn<int8_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt8: return unique_ptr<Column>(new VectorColumn<uint8_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt16: return unique_ptr<Column>(new VectorColumn<int16_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt16: return unique_ptr<Column>(new VectorColumn<uint16_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt32: return unique_ptr<Column>(new VectorColumn<int32_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt32: return unique_ptr<Column>(new VectorColumn<uint32_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kInt64: return unique_ptr<Column>(new VectorColumn<int64_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kUInt64: return unique_ptr<Column>(new VectorColumn<uint64_t>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kFloat: return unique_ptr<Column>(new VectorColumn<float>(terminal, columnIndex, typeCode));
+		case ColumnarFormat::kVector | ColumnarFormat::kDouble: return unique_ptr<Column>(new VectorColumn<double>(terminal, columnIndex, typeCode));
+		default: throw invalid_argument("Unsupported column type code %s for output \"%s\""_format(int(typeCode), terminal.absolutePath()));
+	}
+}
+
+
+void ColumnarFileReader::Entry::connectColumns(const std::vector<std::string> &names, const std::vector<uint8_t> &types) {
+	releaseColumns();
+	for (auto &elem: m_outputs) {
+		OutputTerminal *terminal = elem.second;
+		string columnName = terminal->name().toString();
+		auto found = find(names.begin(), names.end(), columnName);
+		if (found == names.end()) throw runtime_error("Column \"%s\" not found in input of \"%s\""_format(columnName, absolutePath()));
+		size_t columnIndex = size_t(found - names.begin());
+		dbrx_log_debug("Connecting column \"%s\" in \"%s\"", columnName, absolutePath());
+		m_columns.push_back(newColumn(*terminal, columnIndex, types[columnIndex]));
+	}
+}
+
+
+void ColumnarFileReader::Entry::releaseColumns() {
+	for (auto &column: m_columns) column->release();
+	m_columns.clear();
+}
+
+
+void ColumnarFileReader::Entry::loadChunks(const MappedFile &file, const ColumnarFormat::ChunkInfo *blockChunks, uint64_t nEntries) {
+	for (auto &column: m_columns) column->loadChunk(file, blockChunks[column->columnIndex()], nEntries);
+}
+
+
+void ColumnarFileReader::Entry::setEntry(uint64_t i) {
+	for (auto &column: m_columns) column->setEntry(i);
+}
+
+
+ColumnarFileReader::Entry::~Entry() {
+	releaseColumns();
+}
+
+
+void ColumnarFileReader::readFooter() {
+	const char *begin = m_file.data();
+	const char *end = begin + m_file.size();
+	const size_t magicSize = sizeof(ColumnarFormat::s_magic);
+	const size_t headerSize = magicSize + 2 * sizeof(uint32_t);
+
+	if ((m_file.size() < headerSize + sizeof(uint64_t) + magicSize) ||
+		(memcmp(begin, ColumnarFormat::s_magic, magicSize) != 0) ||
+		(memcmp(end - magicSize, ColumnarFormat::s_magic, magicSize) != 0)
+	) throw runtime_error("File \"%s\" is not a dbrx columnar file"_format(m_file.fileName()));
+
+	const char *pos = begin + magicSize;
+	uint32_t version = readPOD<uint32_t>(pos, end);
+	if (version != ColumnarFormat::s_version)
+		throw runtime_error("Unsupported version %s of columnar file \"%s\""_format(version, m_file.fileName()));
+
+	pos = end - magicSize - sizeof(uint64_t);
+	uint64_t footerOffset = readPOD<uint64_t>(pos, end);
+	if ((footerOffset < headerSize) || (footerOffset > m_file.size() - magicSize - sizeof(uint64_t)))
+		throw runtime_error("Invalid footer offset in columnar file \"%s\""_format(m_file.fileName()));
+
+	pos = begin + footerOffset;
+	const char *footerEnd = end - magicSize - sizeof(uint64_t);
+
+	m_columnNames.clear(); m_columnTypes.clear();
+	uint32_t nColumns = readPOD<uint32_t>(pos, footerEnd);
+	for (uint32_t i = 0; i < nColumns; ++i) {
+		m_columnTypes.push_back(readPOD<uint8_t>(pos, footerEnd));
+		uint32_t nameSize = readPOD<uint32_t>(pos, footerEnd);
+		if (size_t(footerEnd - pos) < nameSize) throw runtime_error("Unexpected end of columnar file footer");
+		m_columnNames.push_back(string(pos, nameSize));
+		pos += nameSize;
+	}
+
+	m_blockEntries.clear(); m_chunks.clear();
+	uint64_t nBlocks = readPOD<uint64_t>(pos, footerEnd);
+	for (uint64_t b = 0; b < nBlocks; ++b) {
+		m_blockEntries.push_back(readPOD<uint64_t>(pos, footerEnd));
+		for (uint32_t i = 0; i < nColumns; ++i) {
+			ColumnarFormat::ChunkInfo chunk;
+			chunk.offset = readPOD<uint64_t>(pos, footerEnd);
+			chunk.storedSize = readPOD<uint64_t>(pos, footerEnd);
+			chunk.rawSize = readPOD<uint64_t>(pos, footerEnd);
+			m_chunks.push_back(chunk);
+		}
+	}
+}
+
+
+void ColumnarFileReader::loadBlock(size_t block) {
+	m_blockStart = m_blockEnd;
+	m_blockEnd += m_blockEntries[block];
+	dbrx_log_trace("Loading block %s (entries %s to %s) of columnar file \"%s\" in bric \"%s\"", block, m_blockStart, m_blockEnd, m_file.fileName(), absolutePath());
+	entry.loadChunks(m_file, m_chunks.data() + block * m_columnNames.size(), m_blockEntries[block]);
+}
+
+
+void ColumnarFileReader::processInput() {
+	entry.releaseColumns();
+	m_file.close();
+
+	dbrx_log_debug("Opening columnar file \"%s\" in bric \"%s\""_format(input.get(), absolutePath()));
+	m_file.open(input);
+	readFooter();
+	m_file.advise(MappedFile::Advice::Sequential);
+
+	entry.connectColumns(m_columnNames, m_columnTypes);
+
+	uint64_t nEntries = 0;
+	for (uint64_t n: m_blockEntries) nEntries += n;
+	size = nEntries;
+	index = -1;
+
+	m_nextBlock = 0;
+	m_blockStart = 0;
+	m_blockEnd = 0;
+}
+
+
+bool ColumnarFileReader::nextOutput() {
+	if (index.get() + 1 >= size.get()) return false;
+
+	++index;
+	uint64_t i = uint64_t(index.get());
+	while (i >= m_blockEnd) loadBlock(m_nextBlock++);
+	entry.setEntry(i - m_blockStart);
+	return true;
+}
+
+
+} // namespace dbrx
@@ -0,0 +1,242 @@
+// Copyright (C) 2015 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_COLUMNARBRICS_H
+#define DBRX_COLUMNARBRICS_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+
+#include "Bric.h"
+#include "MappedFile.h"
+
+
+namespace dbrx {
+
+
+/// @brief Definitions for the dbrx columnar file format.
+///
+/// A file consists of a header (magic and format version), a sequence of
+/// blocks and a footer. Each block holds one chunk per column, starting at
+/// an 8-byte aligned file offset. Fixed-width chunks contain the values
+/// back to back, variable-length chunks (strings and vectors) contain n + 1
+/// uint64 byte offsets followed by the data. Chunks may be LZ4 compressed.
+/// The footer lists the column names and types and the position of all
+/// chunks and is followed by its own file offset and the magic. Numbers are
+/// stored in host byte order.
+
+class ColumnarFormat {
+public:
+	enum TypeCode: uint8_t {
+		kBool = 1, kInt8, kUInt8, kInt16, kUInt16, kInt32, kUInt32, kInt64, kUInt64, kFloat, kDouble,
+		kString = 0x20,
+		kVector = 0x40 // Vector types: kVector | element type
+	};
+
+	struct ChunkInfo {
+		uint64_t offset = 0;
+		uint64_t storedSize = 0;
+		uint64_t rawSize = 0;
+
+		bool compressed() const { return storedSize != rawSize; }
+	};
+
+	static const char s_magic[8];
+	static const uint32_t s_version = 1;
+	static const size_t s_alignment = 8;
+
+	/// Type code for values of the given type, 0 if not supported
+	static uint8_t typeCode(const std::type_info &type);
+
+	static std::string typeName(uint8_t code);
+
+	static bool isVariableLength(uint8_t code) { return (code == kString) || (code & kVector); }
+
+	static size_t elementSize(uint8_t code);
+
+	static void compress(const char *src, size_t size, std::vector<char> &compressed, int level);
+	static void decompress(const char *src, size_t size, char *target, size_t rawSize);
+};
+
+
+
+class ColumnarFileWriter: public ReducerBric {
+protected:
+	// Collects values of one input for the current block
+	class Column {
+	protected:
+		std::string m_name;
+		const Value& m_value;
+
+	public:
+		const std::string& name() const { return m_name; }
+
+		virtual uint8_t typeCode() const = 0;
+
+		virtual void append() = 0;
+
+		// Appends uncompressed chunk for current block to data, clears block
+		virtual void takeChunk(std::vector<char> &data) = 0;
+
+		Column(std::string name, const Value& value): m_name(std::move(name)), m_value(value) {}
+		virtual ~Column() {}
+	};
+
+	template<typename T> class FixedColumn;
+	class StringColumn;
+	template<typename T> class VectorColumn;
+
+	std::ofstream m_output;
+	uint64_t m_outputPos = 0;
+
+	std::vector< std::unique_ptr<Column> > m_columns;
+	size_t m_blockFill = 0;
+
+	std::vector<uint64_t> m_blockEntries;
+	std::vector<ColumnarFormat::ChunkInfo> m_chunks;
+
+	std::vector<char> m_chunkData;
+	std::vector<char> m_compressed;
+
+	static std::unique_ptr<Column> newColumn(const std::string &name, const Value& value);
+
+	virtual void writeData(const char *data, size_t size);
+	virtual void writeBlock();
+	virtual void writeFooter();
+
+public:
+	class Entry final: public DynInputGroup {
+	protected:
+		std::vector< std::pair<PropKey, PropPath> > m_inputSources;
+
+		void connectInputs() override;
+		void disconnectInputs() override;
+
+	public:
+		void applyConfig(const PropVal& config) override;
+		PropVal getConfig() const override;
+
+		void processInput() override {}
+
+		std::vector< std::pair<std::string, const InputTerminal*> > columnInputs() const;
+
+		using DynInputGroup::DynInputGroup;
+	};
+
+	Entry entry{this, "entry"};
+
+	Param<std::string> fileName{this, "fileName", "File Name"};
+	Param<int64_t> blockSize{this, "blockSize", "Number of entries per block", 65536};
+	Param<bool> lz4{this, "lz4", "Compress chunks with LZ4 (fixed-width columns are then read from a decompressed copy)", false};
+	Param<int32_t> compressionLevel{this, "compressionLevel", "LZ4 compression level (1 to 9, higher is LZ4HC)", 1};
+
+	Output<std::string> output{this, "", "Output File Name"};
+	Output<ssize_t> size{this, "size", "Number of entries written"};
+
+	void newReduction() override;
+
+	void processInput() override;
+
+	void finalizeReduction() override;
+
+	using ReducerBric::ReducerBric;
+};
+
+
+
+class ColumnarFileReader: public MapperBric {
+protected:
+	MappedFile m_file;
+
+	std::vector<std::string> m_columnNames;
+	std::vector<uint8_t> m_columnTypes;
+	std::vector<uint64_t> m_blockEntries;
+	std::vector<ColumnarFormat::ChunkInfo> m_chunks;
+
+	size_t m_nextBlock = 0;
+	uint64_t m_blockStart = 0;
+	uint64_t m_blockEnd = 0;
+
+	virtual void readFooter();
+	virtual void loadBlock(size_t block);
+
+public:
+	class Entry final: public DynOutputGroup {
+	protected:
+		// Exposes values of one column on an output terminal
+		class Column {
+		protected:
+			OutputTerminal& m_terminal;
+			size_t m_columnIndex;
+			uint8_t m_typeCode;
+
+			std::vector<char> m_decompressed;
+			const char* m_chunk = nullptr;
+			uint64_t m_nEntries = 0;
+
+		public:
+			size_t columnIndex() const { return m_columnIndex; }
+
+			virtual void loadChunk(const MappedFile &file, const ColumnarFormat::ChunkInfo &chunk, uint64_t nEntries);
+			virtual void setEntry(uint64_t i) = 0;
+			virtual void release() {}
+
+			Column(OutputTerminal& terminal, size_t columnIndex, uint8_t typeCode)
+				: m_terminal(terminal), m_columnIndex(columnIndex), m_typeCode(typeCode) {}
+			virtual ~Column() {}
+		};
+
+		template<typename T> class FixedColumn;
+		class StringColumn;
+		template<typename T> class VectorColumn;
+
+		std::vector< std::unique_ptr<Column> > m_columns;
+
+		static std::unique_ptr<Column> newColumn(OutputTerminal& terminal, size_t columnIndex, uint8_t typeCode);
+
+	public:
+		void connectColumns(const std::vector<std::string> &names, const std::vector<uint8_t> &types);
+		void releaseColumns();
+
+		void loadChunks(const MappedFile &file, const ColumnarFormat::ChunkInfo *blockChunks, uint64_t nEntries);
+		void setEntry(uint64_t i);
+
+		using DynOutputGroup::DynOutputGroup;
+		~Entry();
+	};
+
+	Input<std::string> input{this, "", "Input File Name"};
+
+	Entry entry{this, "entry"};
+
+	Output<ssize_t> size{this, "size", "Number of entries"};
+	Output<ssize_t> index{this, "index", "Index of current entry"};
+
+	void processInput() override;
+
+	bool nextOutput() override;
+
+	using MapperBric::MapperBric;
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_COLUMNARBRICS_H
@@ -4,18 +4,27 @@
 #ifdef __CINT__
 
 // basicbrics.h
+// binarybrics.h
+#pragma link C++ class dbrx::BinaryRecordReader-;
 
 // funcbrics.h
 
 // collbrics.h
+// columnarbrics.h
+#pragma link C++ class dbrx::ColumnarFormat-;
+#pragma link C++ class dbrx::ColumnarFileWriter-;
+#pragma link C++ class dbrx::ColumnarFileReader-;
 
 // propsbrics.h
 #pragma link C++ class dbrx::JSON2PropVal-;
 #pragma link C++ class dbrx::PropVal2JSON-;
+#pragma link C++ class dbrx::BinaryPropValReader-;
+#pragma link C++ class dbrx::BinaryPropValWriter-;
 #pragma link C++ class dbrx::PropsBuilder-;
 #pragma link C++ class dbrx::PropsSplitter-;
 
 // rootiobrics.h
+#pragma link C++ class dbrx::RootChainBuilder-;
 #pragma link C++ class dbrx::RootTreeReader-;
 #pragma link C++ class dbrx::RootTreeWriter-;
 #pragma link C++ class dbrx::RootFileReader-;
@@ -23,6 +32,8 @@
 
 // textbrics.h
 #pragma link C++ class dbrx::TextFileReader-;
+#pragma link C++ class dbrx::CsvReader-;
+#pragma link C++ class dbrx::JsonLinesReader-;
 #pragma link C++ class dbrx::TextFileWriter-;
 
 // ApplicationBric.h
@@ -31,6 +42,8 @@
 // ApplicationConfig.h
 #pragma link C++ class dbrx::ApplicationConfig-;
 
+// BlockOutputBuffer.h
+#pragma link C++ class dbrx::BlockOutputBuffer-;
 // Bric.h
 #pragma link C++ class dbrx::Bric-;
 #pragma link C++ class dbrx::Bric::Terminal-;
@@ -49,10 +62,14 @@
 // DbrxTools.h
 #pragma link C++ class dbrx::DbrxTools-;
 
+// FlatMap.h
+
 // ManagedStream.h
 #pragma link C++ class dbrx::ManagedStream-;
 #pragma link C++ class dbrx::ManagedInputStream-;
 #pragma link C++ class dbrx::ManagedOutputStream-;
+// MappedFile.h
+#pragma link C++ class dbrx::MappedFile-;
 
 // MRBric.h
 #pragma link C++ class dbrx::MRBric-;
@@ -64,6 +81,9 @@
 
 #pragma link C++ class dbrx::NameTable-;
 
+// NumberFormat.h
+#pragma link C++ class dbrx::NumberFormat-;
+
 // Props.h
 #pragma link C++ class dbrx::PropVal-;
 
@@ -80,6 +100,8 @@
 // RootRndGen.h
 #pragma link C++ class dbrx::RootRndGen-;
 
+// SmallVector.h
+
 // TypeReflection.h
 #pragma link C++ class dbrx::TypeReflection-;
 
@@ -46,14 +46,15 @@ void task_get_config_printUsage(const char* progName) {
 	cerr << "" << endl;
 	cerr << "Options:" << endl;
 	cerr << "-?              Show help" << endl;
-	cerr << "-f FORMAT       Set output format (formats: [json], ...)" << endl;
+	cerr << "-f FORMAT       Set output format (formats: [json], binary)" << endl;
 	cerr << "-l LEVEL        Set logging level" << endl;
 	cerr << "-V NAME=VALUE   Define variable value for configuration" << endl;
 	cerr << "-s              Disable variable substitution in configuration" << endl;
 	cerr << "-e              Do not use environment variables in configuration" << endl;
 	cerr << "" << endl;
 	cerr << "Combine and output given configurations in specified format (JSON by default)." << endl;
-	cerr << "Supported output formats: \"json\" (more formats to come in future versions)." << endl;
+	cerr << "Supported output formats: \"json\" and \"binary\" (binary PropVal file, load" << endl;
+	cerr << "with file extension \".dbrxb\")." << endl;
 }
 
 
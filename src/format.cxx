@@ -18,6 +18,7 @@
 #include "format.h"
 
 #include <iostream>
+#include <algorithm>
 #include <cstdio>
 #include <stdarg.h>
 
@@ -112,7 +113,7 @@ void FormatString::printFormatted(std::ostream& os, ConstCharRange fmt, ...) {
 	va_end(argp);
 
 	if (nOut < 0) throw runtime_error("Error during string formatting using vsnprintf");
-	else for (int i = 0; i < nOut; ++i) os << outCStr[i];
+	else os.write(outCStr, std::min(nOut, int(outMaxSize) - 1));
 }
 
 
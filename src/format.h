@@ -22,8 +22,10 @@
 #include <sstream>
 #include <stdexcept>
 #include <cstdint>
+#include <type_traits>
 
 #include "funcprog.h"
+#include "NumberFormat.h"
 
 
 namespace dbrx {
@@ -52,8 +54,31 @@ protected:
 protected:
     struct SelectGeneral {};
     struct SelectSpecial : SelectGeneral {};
+    struct SelectNumber : SelectSpecial {};
 
 
+	// Integer and real types that are printed via NumberFormat (characters,
+	// bool and long double are left to operator<<):
+	template<typename T> struct IsFastNumber: std::integral_constant<bool,
+		std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, long double>::value
+		&& !std::is_same<T, char>::value && !std::is_same<T, signed char>::value && !std::is_same<T, unsigned char>::value
+		&& !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value && !std::is_same<T, char32_t>::value
+	> {};
+
+	static std::ostream& printNumber(std::ostream& os, double x) { return NumberFormat::printReal(os, x); }
+	static std::ostream& printNumber(std::ostream& os, float x) { return NumberFormat::printReal(os, x); }
+
+	template<typename T> static typename std::enable_if<std::is_integral<T>::value, std::ostream&>::type
+		printNumber(std::ostream& os, T x)
+	{
+		return std::is_signed<T>::value ? NumberFormat::printInteger(os, int64_t(x)) : NumberFormat::printInteger(os, uint64_t(x));
+	}
+
+
+	template<typename T> static auto universalPrint(std::ostream& os, T&& x, SelectNumber)
+		-> typename std::enable_if<IsFastNumber<typename std::decay<T>::type>::value, std::ostream&>::type
+		{ return printNumber(os, x); }
+
 	template<typename T> static auto universalPrint(std::ostream& os, T&& x, SelectSpecial)
 		-> decltype(os << std::forward<T>(x)) { return os << std::forward<T>(x); }
 
@@ -107,7 +132,7 @@ protected:
 		using namespace std;
 		ConstCharRange fmtElem = findFmtElem(fmt);
 		if (fmtElem.empty()) throw std::invalid_argument("Less format elements in format string than arguments.");
-		for (char c: ConstCharRange(fmt.begin(), fmtElem.begin())) os << c;
+		os.write(fmt.begin(), fmtElem.begin() - fmt.begin());
 		if ((fmtElem.size() == 2) && (fmtElem[0] == '%') && (fmtElem[1] == 's'))
 			printAny(os, std::forward<T>(x));
 		else printFormattedValue(os, fmtElem, std::forward<T>(x));
@@ -116,12 +141,12 @@ protected:
 
 	void applyValues(std::ostream& os, ConstCharRange fmt) {
 		if (!findFmtElem(fmt).empty()) throw std::invalid_argument("More format elements in format string than arguments.");
-		else for (char c: fmt) os << c;
+		else os.write(fmt.begin(), fmt.size());
 	}
 
 public:
 	template<typename T> static std::ostream& printAny(std::ostream& os, T&& x)
-		{ return universalPrint(os, std::forward<T>(x), SelectSpecial()); }
+		{ return universalPrint(os, std::forward<T>(x), SelectNumber()); }
 
 	template<typename T> static std::string anyToString(T&& x)
 		{ return universalToString(std::forward<T>(x), SelectSpecial()); }
@@ -17,6 +17,8 @@
 
 #include "propsbrics.h"
 
+#include <cstring>
+
 #include "logging.h"
 
 using namespace std;
@@ -25,6 +27,106 @@ using namespace std;
 namespace dbrx {
 
 
+void BinaryPropValReader::processInput() {
+	dbrx_log_trace("BinaryPropValReader \"%s\", opening next input \"%s\""_format(absolutePath(), input.get()));
+	m_mappedFile.close();
+	const string &magic = PropVal::binaryFileMagic();
+	bool validMagic = false;
+	try {
+		if (memoryMap && MappedFile::isMappable(input)) {
+			m_mappedFile.open(input);
+			m_mappedFile.advise(MappedFile::Advice::Sequential);
+			validMagic = (m_mappedFile.size() >= magic.size()) && (memcmp(m_mappedFile.data(), magic.data(), magic.size()) == 0);
+			m_mappedPos = magic.size();
+		} else {
+			m_inputStream.open(input);
+			m_record.assign(magic.size(), '\0');
+			validMagic = m_inputStream.stream().read(&m_record[0], m_record.size()) && (m_record == magic);
+		}
+	} catch (std::runtime_error &e) {
+		throw runtime_error("Can't open \"%s\" for input in bric \"%s\": %s"_format(input.get(), absolutePath(), e.what()));
+	}
+	if (!validMagic) throw runtime_error("Input \"%s\" of bric \"%s\" is not a binary PropVal file"_format(input.get(), absolutePath()));
+	index = -1;
+}
+
+
+bool BinaryPropValReader::nextMappedValue() {
+	const char *data = m_mappedFile.data();
+	size_t size = m_mappedFile.size();
+	if (m_mappedPos >= size) return false;
+	if (size - m_mappedPos < 4) throw runtime_error("Unexpected end of binary PropVal record");
+
+	const uint8_t *p = reinterpret_cast<const uint8_t*>(data + m_mappedPos);
+	size_t n = size_t(p[0]) | size_t(p[1]) << 8 | size_t(p[2]) << 16 | size_t(p[3]) << 24;
+	m_mappedPos += 4;
+	if (size - m_mappedPos < n) throw runtime_error("Unexpected end of binary PropVal record");
+
+	const char *pos = data + m_mappedPos;
+	const char *end = pos + n;
+	output = PropVal::fromBinary(pos, end);
+	if (pos != end) throw runtime_error("Unexpected trailing data in binary PropVal record");
+	m_mappedPos += n;
+	return true;
+}
+
+
+bool BinaryPropValReader::nextStreamValue() {
+	if (!PropVal::readBinaryRecord(m_inputStream.stream(), m_record)) return false;
+	output = PropVal::fromBinary(m_record);
+	return true;
+}
+
+
+bool BinaryPropValReader::nextOutput() {
+	bool hasOutput = false;
+	try {
+		hasOutput = m_mappedFile.isOpen() ? nextMappedValue() : nextStreamValue();
+	} catch (std::runtime_error &e) {
+		throw runtime_error("Invalid data in \"%s\" in bric \"%s\": %s"_format(input.get(), absolutePath(), e.what()));
+	}
+
+	if (hasOutput) {
+		index += 1;
+	} else {
+		if (m_mappedFile.isOpen()) m_mappedFile.close();
+		else m_inputStream.close();
+	}
+	return hasOutput;
+}
+
+
+
+void BinaryPropValWriter::newReduction() {
+	dbrx_log_trace("BinaryPropValWriter \"%s\", opening output \"%s\""_format(absolutePath(), target.get()));
+	try {
+		m_outputStream.open(target);
+	} catch (std::runtime_error &e) {
+		throw runtime_error("Can't open \"%s\" for output in bric \"%s\": %s"_format(target.get(), absolutePath(), e.what()));
+	}
+	m_outputStream.stream() << PropVal::binaryFileMagic();
+	m_nValues = 0;
+}
+
+
+void BinaryPropValWriter::processInput() {
+	m_record.clear();
+	input->toBinary(m_record);
+	PropVal::writeBinaryRecord(m_outputStream.stream(), m_record);
+	++m_nValues;
+}
+
+
+void BinaryPropValWriter::finalizeReduction() {
+	dbrx_log_trace("BinaryPropValWriter \"%s\", closing output \"%s\""_format(absolutePath(), target.get()));
+	m_outputStream.stream().flush();
+	if (!m_outputStream.stream()) throw runtime_error("Output to \"%s\" failed in bric \"%s\""_format(target.get(), absolutePath()));
+	output = m_nValues;
+	m_outputStream.close();
+}
+
+
+
 Bric::InputTerminal* PropsSplitter::ContentGroup::connectInputToInner(Bric &bric, PropKey inputName, PropPath::Fragment sourcePath) {
 	if (sourcePath.size() >= 2) subGroup(sourcePath.front());
 	return Bric::connectInputToInner(bric, inputName, sourcePath);
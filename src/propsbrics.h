@@ -21,6 +21,8 @@
 #include <functional>
 
 #include "Bric.h"
+#include "ManagedStream.h"
+#include "MappedFile.h"
 
 
 namespace dbrx {
@@ -43,13 +45,66 @@ public:
 	Input<PropVal> input{this};
 	Output<std::string> output{this};
 
-	void processInput() { output = input->toJSON(); }
+	// Reuses the storage of the output string:
+	void processInput() { output.get().clear(); input->toJSON(output.get()); }
 
 	using TransformBric::TransformBric;
 };
 
 
 
+class BinaryPropValReader: public MapperBric {
+protected:
+	ManagedInputStream m_inputStream;
+	std::string m_record;
+
+	MappedFile m_mappedFile;
+	size_t m_mappedPos = 0;
+
+	virtual bool nextMappedValue();
+	virtual bool nextStreamValue();
+
+public:
+	Input<std::string> input{this, "", "Input filename (binary PropVal file, see PropVal::binaryFileMagic)"};
+
+	Param<bool> memoryMap{this, "memoryMap", "Map regular input files into memory and decode values in place (stdin and pipes are read via stream)", true};
+
+	Output<PropVal> output{this, "", "Output value"};
+	Output<ssize_t> index{this, "index", "Index of current output"};
+
+	void processInput() override;
+
+	bool nextOutput() override;
+
+	using MapperBric::MapperBric;
+};
+
+
+
+class BinaryPropValWriter: public ReducerBric {
+protected:
+	ManagedOutputStream m_outputStream;
+	std::string m_record;
+	ssize_t m_nValues = 0;
+
+public:
+	Input<PropVal> input{this, "", "Input value"};
+
+	Param<std::string> target{this, "target", "Output filename", "-"};
+
+	Output<ssize_t> output{this, "", "Number of values in output"};
+
+	void newReduction() override;
+
+	void processInput() override;
+
+	void finalizeReduction() override;
+
+	using ReducerBric::ReducerBric;
+};
+
+
+
 class PropsSplitter: public TransformBric {
 public:
 	class ContentGroup final: public DynOutputGroup {
@@ -17,7 +17,35 @@
 
 #include "rootiobrics.h"
 
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cassert>
+#include <atomic>
+
+#include <glob.h>
+
 #include <TH1.h>
+#include <TEntryList.h>
+#include <TString.h>
+#include <TLeaf.h>
+#include <TDataType.h>
+#include <TTreeCache.h>
+#include <TVirtualPerfStats.h>
+#include <TROOT.h>
+#include <TSystem.h>
+#include <TMemFile.h>
+#include <RVersion.h>
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+#include <ROOT/TBufferMerger.hxx>
+#endif
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+#include <TBufferFile.h>
+#include <TBulkBranchRead.hxx>
+#include <Bytes.h>
+#endif
 
 #include "logging.h"
 #include "RootIO.h"
@@ -30,6 +58,148 @@ using namespace std;
 namespace dbrx {
 
 
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,22,0)
+	using ROOT::TBufferMerger;
+	using ROOT::TBufferMergerFile;
+#elif ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+	using ROOT::Experimental::TBufferMerger;
+	using ROOT::Experimental::TBufferMergerFile;
+#endif
+
+
+void RootChainBuilder::expandGlob(const std::string &pattern, std::vector<std::string> &fileNames) {
+	// Names without wildcards (e.g. remote URLs) are used as they are:
+	if (pattern.find_first_of("*?[") == string::npos) {
+		fileNames.push_back(pattern);
+		return;
+	}
+
+	glob_t globResult;
+	int status = glob(pattern.c_str(), 0, nullptr, &globResult);
+	if (status == 0) {
+		for (size_t i = 0; i < globResult.gl_pathc; ++i) fileNames.push_back(globResult.gl_pathv[i]);
+	} else if (status == GLOB_NOMATCH) {
+		dbrx_log_warn("No files match input file pattern \"%s\"", pattern);
+	} else {
+		globfree(&globResult);
+		throw runtime_error("Failed to expand input file pattern \"%s\""_format(pattern));
+	}
+	globfree(&globResult);
+}
+
+
+std::vector<std::string> RootChainBuilder::inputFileNames() {
+	vector<string> fileNames;
+	for (const auto &pattern: files.get()) expandGlob(pattern, fileNames);
+
+	if (!fileList->empty()) {
+		ifstream in(fileList.get());
+		if (!in) throw runtime_error("Could not open input file list \"%s\""_format(fileList.get()));
+		string line;
+		while (getline(in, line)) {
+			size_t begin = line.find_first_not_of(" \t\r");
+			if ((begin == string::npos) || (line[begin] == '#')) continue;
+			size_t end = line.find_last_not_of(" \t\r");
+			expandGlob(line.substr(begin, end + 1 - begin), fileNames);
+		}
+	}
+
+	return fileNames;
+}
+
+
+void RootChainBuilder::probeEntries(const std::vector<std::string> &fileNames, const std::vector<size_t> &indices, std::vector<Long64_t> &entries) {
+	#if ROOT_VERSION_CODE >= ROOT_VERSION(6,4,0)
+		ROOT::EnableThreadSafety();
+	#endif
+
+	size_t nWorkers = (nThreads.get() > 0) ? size_t(nThreads.get()) : std::max(thread::hardware_concurrency(), 1u);
+	nWorkers = std::min(nWorkers, indices.size());
+	dbrx_log_debug("Reading entry counts of %s files with %s threads in bric \"%s\"", indices.size(), nWorkers, absolutePath());
+
+	const string inputTreeName = treeName;
+	atomic<size_t> nextIndex(0);
+	mutex errorMutex;
+	vector<string> errors;
+
+	auto worker = [&]() {
+		for (size_t i = nextIndex++; i < indices.size(); i = nextIndex++) {
+			const string &fileName = fileNames[indices[i]];
+			unique_ptr<TFile> file(TFile::Open(fileName.c_str(), "read"));
+			TTree *tree = ((file != nullptr) && !file->IsZombie()) ? dynamic_cast<TTree*>(file->Get(inputTreeName.c_str())) : nullptr;
+			if (tree != nullptr) {
+				entries[indices[i]] = tree->GetEntries();
+			} else {
+				lock_guard<mutex> lock(errorMutex);
+				errors.push_back("Could not read tree \"%s\" from file \"%s\""_format(inputTreeName, fileName));
+			}
+		}
+	};
+
+	vector<thread> workers;
+	for (size_t i = 0; i < nWorkers; ++i) workers.push_back(thread(worker));
+	for (auto &t: workers) t.join();
+
+	if (!errors.empty()) throw runtime_error("%s (and %s more errors)"_format(errors.front(), errors.size() - 1));
+}
+
+
+void RootChainBuilder::import() {
+	vector<string> fileNames = inputFileNames();
+	vector<Long64_t> entries(fileNames.size(), -1);
+
+	// Entry counts are cached by file path and valid as long as file size and
+	// modification time do not change:
+	const string &cacheFile = entryCountCache.get();
+	PropVal cache = Props();
+	if (!cacheFile.empty() && !gSystem->AccessPathName(cacheFile.c_str()))
+		cache = PropVal::fromFile(cacheFile);
+
+	vector<FileStat_t> fileStats(fileNames.size());
+	vector<bool> haveStat(fileNames.size(), false);
+	vector<size_t> toProbe;
+	for (size_t i = 0; i < fileNames.size(); ++i) {
+		haveStat[i] = !cacheFile.empty() && (gSystem->GetPathInfo(fileNames[i].c_str(), fileStats[i]) == 0);
+		if (haveStat[i] && cache.contains(fileNames[i])) {
+			const PropVal &cached = cache[fileNames[i]];
+			if ((cached["size"].asLong64() == fileStats[i].fSize) && (cached["mtime"].asLong64() == int64_t(fileStats[i].fMtime))) {
+				entries[i] = cached["entries"].asLong64();
+				continue;
+			}
+		}
+		toProbe.push_back(i);
+	}
+	dbrx_log_debug("Using cached entry counts for %s of %s input files in bric \"%s\"", fileNames.size() - toProbe.size(), fileNames.size(), absolutePath());
+
+	if (!toProbe.empty()) {
+		probeEntries(fileNames, toProbe, entries);
+
+		if (!cacheFile.empty()) {
+			for (size_t i: toProbe) if (haveStat[i]) {
+				Props cached;
+				cached["size"] = int64_t(fileStats[i].fSize);
+				cached["mtime"] = int64_t(fileStats[i].fMtime);
+				cached["entries"] = int64_t(entries[i]);
+				cache[fileNames[i]] = PropVal(std::move(cached));
+			}
+			dbrx_log_debug("Writing entry count cache \"%s\" in bric \"%s\"", cacheFile, absolutePath());
+			cache.toFile(cacheFile);
+		}
+	}
+
+	// TChain won't open files added with known entry counts until they are
+	// read. Files without entries are skipped, TChain::Add would probe them.
+	unique_ptr<TChain> chain(new TChain(treeName.get().c_str()));
+	for (size_t i = 0; i < fileNames.size(); ++i) {
+		if (entries[i] > 0) chain->Add(fileNames[i].c_str(), entries[i]);
+		else dbrx_log_debug("Skipping input file \"%s\" without entries in bric \"%s\"", fileNames[i], absolutePath());
+	}
+	dbrx_log_info("Created chain of %s input files in bric \"%s\"", chain->GetNtrees(), absolutePath());
+	output.value() = std::move(chain);
+}
+
+
+
 void RootTreeReader::Entry::connectBranches(Bric* contextBric, TTree* inputTree) {
 	for (auto &elem: m_outputs) {
 		OutputTerminal *terminal = elem.second;
@@ -39,7 +209,205 @@ void RootTreeReader::Entry::connectBranches(Bric* contextBric, TTree* inputTree)
 }
 
 
+template<typename T> class RootTreeReader::Entry::TypedColumn final: public Column {
+protected:
+	OutputTerminal& m_terminal;
+	T m_buffer{};
+
+	#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+	TBufferFile m_basketBuffer{TBuffer::kWrite, 32 * 1024};
+	bool m_bulkRead = false;
+
+	// Fills column from the serialized (big-endian) basket contents,
+	// without unpacking the basket entry by entry:
+	bool readEntriesBulk(std::vector<T> &column, Long64_t from, Long64_t until) {
+		const Long64_t *basketEntry = m_branch->GetBasketEntry();
+		Long64_t basketFirst = *(std::upper_bound(basketEntry, basketEntry + m_branch->GetWriteBasket() + 1, from) - 1);
+
+		Int_t nRead = m_branch->GetBulkRead().GetEntriesSerialized(from, m_basketBuffer);
+		if (nRead < 0) throw runtime_error("Failed to read basket with entry %s of branch \"%s\""_format(from, m_branchName));
+		if (basketFirst + nRead < until) return false;
+
+		char *pos = m_basketBuffer.GetCurrent() + (from - basketFirst) * sizeof(T);
+		for (Long64_t i = 0; i < until - from; ++i) frombuf(pos, &column[i]);
+		return true;
+	}
+	#endif
+
+public:
+	void attachTo(TTree* tree) override {
+		m_branch = tree->GetBranch(m_branchName.c_str());
+		if (m_branch == nullptr) throw runtime_error("Branch \"%s\" not found"_format(m_branchName));
+
+		TObjArray *leaves = m_branch->GetListOfLeaves();
+		TLeaf *leaf = (leaves->GetEntries() == 1) ? dynamic_cast<TLeaf*>(leaves->At(0)) : nullptr;
+		if ((leaf == nullptr) || (leaf->GetLeafCount() != nullptr) || (leaf->GetLen() != 1))
+			throw invalid_argument("Branch \"%s\" is not a flat primitive branch, can't read it as a column"_format(m_branchName));
+		const char *columnTypeName = TDataType::GetTypeName(TDataType::GetType(typeid(T)));
+		if (string(leaf->GetTypeName()) != columnTypeName)
+			throw invalid_argument("Type %s of branch \"%s\" doesn't match column type %s"_format(leaf->GetTypeName(), m_branchName, columnTypeName));
+
+		m_branch->SetAddress(&m_buffer);
+
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+		m_bulkRead = m_branch->GetBulkRead().SupportsBulkRead();
+		if (!m_bulkRead) dbrx_log_debug("Branch \"%s\" doesn't support bulk reading, reading it entry by entry", m_branchName);
+		#endif
+	}
+
+	void readEntries(Long64_t from, Long64_t until) override {
+		std::vector<T> &column = *m_terminal.value().typedPtr< std::vector<T> >();
+		column.resize(until - from);
+
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+		if (m_bulkRead && readEntriesBulk(column, from, until)) return;
+		#endif
+
+		// Fallback for older ROOT versions and branches without bulk read
+		// support - consecutive reads within one basket only copy from the
+		// already decompressed basket buffer:
+		for (Long64_t i = from; i < until; ++i) {
+			if (m_branch->GetEntry(i) <= 0) throw runtime_error("Failed to read entry %s of branch \"%s\""_format(i, m_branchName));
+			column[i - from] = m_buffer;
+		}
+	}
+
+	void readEntries(const std::vector<Long64_t> &localEntries) override {
+		std::vector<T> &column = *m_terminal.value().typedPtr< std::vector<T> >();
+		column.resize(localEntries.size());
+		for (size_t i = 0; i < localEntries.size(); ++i) {
+			if (m_branch->GetEntry(localEntries[i]) <= 0) throw runtime_error("Failed to read entry %s of branch \"%s\""_format(localEntries[i], m_branchName));
+			column[i] = m_buffer;
+		}
+	}
+
+	TypedColumn(OutputTerminal& terminal)
+		: Column(terminal.name().toString()), m_terminal(terminal)
+	{
+		if (m_terminal.value().empty()) m_terminal.value().setToDefault();
+	}
+};
+
+
+Long64_t RootTreeReader::Entry::Column::basketEnd(Long64_t localEntry) const {
+	const Long64_t *basketEntry = m_branch->GetBasketEntry();
+	const Long64_t *basketEntryEnd = basketEntry + m_branch->GetWriteBasket() + 1;
+	const Long64_t *next = std::upper_bound(basketEntry, basketEntryEnd, localEntry);
+	return (next != basketEntryEnd) ? *next : m_branch->GetEntries();
+}
+
+
+std::unique_ptr<RootTreeReader::Entry::Column> RootTreeReader::Entry::newColumn(OutputTerminal& terminal) {
+	const std::type_info &type = terminal.value().typeInfo();
+	if (type == typeid(std::vector<Int_t>)) return unique_ptr<Column>(new TypedColumn<Int_t>(terminal));
+	else if (type == typeid(std::vector<Float_t>)) return unique_ptr<Column>(new TypedColumn<Float_t>(terminal));
+	else if (type == typeid(std::vector<Double_t>)) return unique_ptr<Column>(new TypedColumn<Double_t>(terminal));
+	else throw invalid_argument("Output \"%s\" has unsupported type %s for columnar reading, must be std::vector of Int_t, Float_t or Double_t"_format(terminal.absolutePath(), TypeReflection(type).name()));
+}
+
+
+void RootTreeReader::Entry::connectColumns(Bric* contextBric, TTree* inputTree) {
+	m_columns.clear();
+	for (auto &elem: m_outputs) {
+		OutputTerminal *terminal = elem.second;
+		dbrx_log_debug("Connecting TTree branch \"%s\" as column in \"%s\"", terminal->name(), absolutePath());
+		string branchName = terminal->name().toString();
+		if (inputTree->GetBranch(branchName.c_str()) == nullptr) throw runtime_error("Branch \"%s\" not found"_format(branchName));
+		inputTree->SetBranchStatus(branchName.c_str(), true);
+		inputTree->AddBranchToCache(branchName.c_str());
+		m_columns.push_back(newColumn(*terminal));
+	}
+}
+
+
+void RootTreeReader::Entry::attachColumns(TTree* currentTree) {
+	for (auto &column: m_columns) column->attachTo(currentTree);
+}
+
+
+Long64_t RootTreeReader::Entry::columnsBasketEnd(Long64_t localEntry) const {
+	Long64_t end = std::numeric_limits<Long64_t>::max();
+	for (const auto &column: m_columns) end = std::min(end, column->basketEnd(localEntry));
+	return end;
+}
+
+
+void RootTreeReader::Entry::readColumns(Long64_t from, Long64_t until) {
+	for (auto &column: m_columns) column->readEntries(from, until);
+}
+
+
+void RootTreeReader::Entry::readColumns(const std::vector<Long64_t> &localEntries) {
+	for (auto &column: m_columns) column->readEntries(localEntries);
+}
+
+
+bool RootTreeReader::hasEntrySelection() {
+	return !entryList.hasFixedValue() || !entryList->empty() || !entryListFile->empty();
+}
+
+
+void RootTreeReader::loadEntrySelection() {
+	m_selectedEntries.assign(entryList->begin(), entryList->end());
+	if (!entryListFile->empty()) readEntryListFile(entryListFile, m_selectedEntries);
+
+	// Read in ascending order, so each basket is decompressed at most once:
+	auto &entries = m_selectedEntries;
+	std::sort(entries.begin(), entries.end());
+	entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+	int64_t from = firstEntry, until = firstEntry + size.get();
+	entries.erase(entries.begin(), std::lower_bound(entries.begin(), entries.end(), from));
+	entries.erase(std::lower_bound(entries.begin(), entries.end(), until), entries.end());
+
+	dbrx_log_debug("Selected %s entries for reading in bric \"%s\"", entries.size(), absolutePath());
+}
+
+
+void RootTreeReader::readEntryListFile(const std::string &fileName, std::vector<int64_t> &entries) {
+	size_t rootExtPos = fileName.rfind(".root:");
+	if (rootExtPos != fileName.npos) {
+		string rootFileName = fileName.substr(0, rootExtPos + 5);
+		string listName = fileName.substr(rootExtPos + 6);
+		dbrx_log_debug("Reading TEntryList \"%s\" from \"%s\" in bric \"%s\"", listName, rootFileName, absolutePath());
+		unique_ptr<TFile> listFile(TFile::Open(rootFileName.c_str(), "READ"));
+		if (!listFile || listFile->IsZombie()) throw runtime_error("Could not open TFile \"%s\""_format(rootFileName));
+		TEntryList *list = dynamic_cast<TEntryList*>(listFile->Get(listName.c_str()));
+		if (list == nullptr) throw runtime_error("Could not read TEntryList \"%s\" from \"%s\""_format(listName, rootFileName));
+
+		// Sub-lists of a TEntryList have entry numbers local to their tree,
+		// and their order needn't match the chain. Let the chain match them
+		// to its trees by tree and file name:
+		m_chain->SetEntryList(list);
+		Long64_t nUnmatched = 0;
+		entries.reserve(entries.size() + list->GetN());
+		for (Long64_t i = 0; i < list->GetN(); ++i) {
+			Long64_t chainEntry = m_chain->GetEntryNumber(i);
+			if (chainEntry >= 0) entries.push_back(chainEntry);
+			else ++nUnmatched;
+		}
+		m_chain->SetEntryList(nullptr);
+		if (nUnmatched > 0) throw runtime_error("%s entries in TEntryList \"%s\" from \"%s\" don't belong to any tree of the input chain in bric \"%s\""_format(nUnmatched, listName, rootFileName, absolutePath()));
+	} else if (TString(fileName).EndsWith(".json")) {
+		std::vector<int64_t> fromJSON;
+		assign_from(fromJSON, PropVal::fromFile(fileName));
+		entries.insert(entries.end(), fromJSON.begin(), fromJSON.end());
+	} else {
+		ifstream in(fileName.c_str());
+		if (!in) throw runtime_error("Could not open entry list file \"%s\""_format(fileName));
+		int64_t entryNo = 0;
+		while (in >> entryNo) entries.push_back(entryNo);
+		if (!in.eof()) throw runtime_error("Invalid content in entry list file \"%s\""_format(fileName));
+	}
+}
+
+
 void RootTreeReader::processInput() {
+	stopIOStats();
+
+	if ((input->GetDirectory() != nullptr) && (dynamic_cast<TMemFile*>(input->GetDirectory()->GetFile()) != nullptr))
+		throw runtime_error("Can't read TTree \"%s\" from in-memory file \"%s\" in bric \"%s\""_format(input->GetName(), input->GetDirectory()->GetFile()->GetName(), absolutePath()));
+
 	auto inputTChain = dynamic_cast<const TChain*>(input.value().ptr());
 	if (inputTChain != nullptr) {
 		// If input is a TChain, we can simply clone it
@@ -58,30 +426,257 @@ void RootTreeReader::processInput() {
 		m_chain->Add(fileName.c_str());
 	}
 
-	m_chain->SetCacheSize(cacheSize);
+	if (autoCacheSize) {
+		if (m_chain->LoadTree(firstEntry) < 0) throw runtime_error("Failed to load tree for entry %s in bric \"%s\""_format(firstEntry.get(), absolutePath()));
+		Long64_t autoSize = autoCacheSizeFor(m_chain->GetTree());
+		dbrx_log_debug("Using automatic read-ahead cache size of %s bytes in bric \"%s\"", autoSize, absolutePath());
+		m_chain->SetCacheSize(autoSize);
+	} else {
+		m_chain->SetCacheSize(cacheSize);
+	}
+	if (cacheLearnEntries.get() > 0) m_chain->SetCacheLearnEntries(cacheLearnEntries);
 	m_chain->SetBranchStatus("*", false);
 
-	entry.connectBranches(this, m_chain.get());
+	if (columnar) entry.connectColumns(this, m_chain.get());
+	else entry.connectBranches(this, m_chain.get());
 
 	index = firstEntry - 1;
 	size = m_chain->GetEntries() - firstEntry.get();
 	if (ssize_t(nEntries) > 0) size = std::min(ssize_t(nEntries), size.get());
+
+	m_sparse = hasEntrySelection();
+	if (m_sparse) {
+		loadEntrySelection();
+		size = m_selectedEntries.size();
+	}
+	m_nextSelected = 0;
+
+	m_columnsTreeNumber = -1;
+	m_nextEntry = firstEntry;
+	batchEntries = 0;
+
+	if (!m_sparse && (size.get() > 0)) m_chain->SetCacheEntryRange(firstEntry, firstEntry.get() + size.get());
+
+	if (ioStats) startIOStats();
+}
+
+
+std::vector<TBranch*> RootTreeReader::connectedBranches(TTree* tree) {
+	// Collect leaf-level branches, split object branches store no data themselves:
+	std::function<void(TBranch*, std::vector<TBranch*>&)> collect = [&collect](TBranch* branch, std::vector<TBranch*> &branches) {
+		TObjArray *subBranches = branch->GetListOfBranches();
+		if ((subBranches == nullptr) || (subBranches->GetEntriesFast() == 0)) branches.push_back(branch);
+		else for (Int_t i = 0; i < subBranches->GetEntriesFast(); ++i)
+			collect(dynamic_cast<TBranch*>(subBranches->At(i)), branches);
+	};
+
+	std::vector<TBranch*> branches;
+	for (const auto &elem: entry.outputs()) {
+		TBranch *branch = tree->GetBranch(elem.first.toString().c_str());
+		if (branch != nullptr) collect(branch, branches);
+	}
+	return branches;
+}
+
+
+Long64_t RootTreeReader::autoCacheSizeFor(TTree* tree) {
+	// The cache should hold one cluster of all connected branches, or at
+	// least one basket per branch if clustering is unknown:
+	Long64_t treeEntries = tree->GetEntries();
+	Long64_t clusterEntries = (tree->GetAutoFlush() > 0) ? std::min(tree->GetAutoFlush(), treeEntries) : treeEntries;
+
+	double clusterBytes = 0, basketBytes = 0;
+	for (TBranch *branch: connectedBranches(tree)) {
+		double zipBytes = branch->GetZipBytes();
+		basketBytes += zipBytes / std::max(branch->GetWriteBasket(), 1);
+		if (treeEntries > 0) clusterBytes += zipBytes * clusterEntries / treeEntries;
+	}
+
+	double autoSize = std::max(clusterBytes, basketBytes) * 1.1;
+	return Long64_t(std::min(autoSize, double(cacheMemBudget.get())));
+}
+
+
+void RootTreeReader::startIOStats() {
+	m_perfStats = unique_ptr<TTreePerfStats>(new TTreePerfStats("ioperf", m_chain.get()));
+	m_branchIOStats.clear();
+	m_ioStatsTreeNumber = -1;
+	m_ioStatsReported = false;
+}
+
+
+void RootTreeReader::updateIOStats() {
+	if (!m_perfStats) return;
+
+	if (m_chain->GetTreeNumber() != m_ioStatsTreeNumber) {
+		// Branch objects change with every tree in the chain:
+		std::vector<TBranch*> branches = connectedBranches(m_chain->GetTree());
+		if (m_branchIOStats.empty()) {
+			for (TBranch *branch: branches) {
+				m_branchIOStats.push_back(BranchIOStats());
+				m_branchIOStats.back().name = branch->GetName();
+			}
+		}
+		for (size_t i = 0; i < m_branchIOStats.size(); ++i) {
+			m_branchIOStats[i].branch = (i < branches.size()) ? branches[i] : nullptr;
+			m_branchIOStats[i].lastBasket = -1;
+		}
+		m_ioStatsTreeNumber = m_chain->GetTreeNumber();
+	}
+
+	for (auto &stats: m_branchIOStats) {
+		if (stats.branch == nullptr) continue;
+		Int_t basket = stats.branch->GetReadBasket();
+		if ((basket != stats.lastBasket) && (basket >= 0) && (basket < stats.branch->GetWriteBasket())) {
+			++stats.nBaskets;
+			stats.zipBytes += stats.branch->GetBasketBytes()[basket];
+			stats.lastBasket = basket;
+		}
+	}
+}
+
+
+void RootTreeReader::reportIOStats() {
+	if (!m_perfStats || m_ioStatsReported) return;
+	m_ioStatsReported = true;
+
+	const double MB = 1024. * 1024.;
+	TTreeCache *cache = m_chain->GetReadCache(m_chain->GetCurrentFile());
+	dbrx_log_info("I/O statistics of bric \"%s\": %s read calls, %.3f MB read, %.3f s unzip time, cache efficiency %.3f (%.1f MB cache, last file)",
+		absolutePath(), m_perfStats->GetReadCalls(), double(m_perfStats->GetBytesRead()) / MB, m_perfStats->GetUnzipTime(),
+		(cache != nullptr) ? cache->GetEfficiency() : 0., double(m_chain->GetCacheSize()) / MB);
+
+	for (const auto &stats: m_branchIOStats) {
+		dbrx_log_info("I/O statistics of branch \"%s\" in bric \"%s\": %s baskets, %.3f MB compressed",
+			stats.name, absolutePath(), stats.nBaskets, double(stats.zipBytes) / MB);
+	}
+}
+
+
+void RootTreeReader::stopIOStats() {
+	if (!m_perfStats) return;
+	// TTreePerfStats registers itself globally and with the tree:
+	if (m_chain) m_chain->SetPerfStats(nullptr);
+	if (gPerfStats == m_perfStats.get()) gPerfStats = nullptr;
+	m_perfStats.reset();
+	m_branchIOStats.clear();
+}
+
+
+Long64_t RootTreeReader::loadColumnsTree(Long64_t entryNo) {
+	Long64_t localEntry = m_chain->LoadTree(entryNo);
+	if (localEntry < 0) throw runtime_error("Failed to load tree for entry %s in bric \"%s\""_format(entryNo, absolutePath()));
+	if (m_chain->GetTreeNumber() != m_columnsTreeNumber) {
+		dbrx_log_trace("Attaching columns to tree number %s in bric \"%s\"", m_chain->GetTreeNumber(), absolutePath());
+		entry.attachColumns(m_chain->GetTree());
+		m_columnsTreeNumber = m_chain->GetTreeNumber();
+	}
+	return localEntry;
+}
+
+
+bool RootTreeReader::nextColumnBatch() {
+	if (m_sparse) {
+		if (m_nextSelected >= m_selectedEntries.size()) return false;
+
+		Long64_t batchFirst = m_selectedEntries[m_nextSelected];
+		Long64_t localEntry = loadColumnsTree(batchFirst);
+		Long64_t treeOffset = batchFirst - localEntry;
+		Long64_t localEnd = std::min(m_chain->GetTree()->GetEntries(), entry.columnsBasketEnd(localEntry));
+
+		m_batchLocalEntries.clear();
+		while (
+			(m_nextSelected < m_selectedEntries.size()) &&
+			(m_selectedEntries[m_nextSelected] - treeOffset < localEnd) &&
+			((batchSize.get() <= 0) || (int64_t(m_batchLocalEntries.size()) < batchSize.get()))
+		) {
+			m_batchLocalEntries.push_back(m_selectedEntries[m_nextSelected++] - treeOffset);
+		}
+
+		entry.readColumns(m_batchLocalEntries);
+
+		index = batchFirst;
+		batchEntries = m_batchLocalEntries.size();
+		return true;
+	}
+
+	Long64_t until = firstEntry.get() + size.get();
+	if (m_nextEntry >= until) return false;
+
+	Long64_t localEntry = loadColumnsTree(m_nextEntry);
+	TTree *currentTree = m_chain->GetTree();
+
+	// Batches never cross basket (or tree) boundaries:
+	Long64_t n = std::min(until - m_nextEntry, currentTree->GetEntries() - localEntry);
+	n = std::min(n, entry.columnsBasketEnd(localEntry) - localEntry);
+	if (batchSize.get() > 0) n = std::min(n, Long64_t(batchSize.get()));
+
+	entry.readColumns(localEntry, localEntry + n);
+
+	index = m_nextEntry;
+	batchEntries = n;
+	m_nextEntry += n;
+	return true;
 }
 
 
 bool RootTreeReader::nextOutput() {
-	if (index.get() + 1 < firstEntry.get() + size.get()) {
+	bool hasOutput = false;
+
+	if (columnar) {
+		hasOutput = nextColumnBatch();
+	} else if (m_sparse) {
+		if (m_nextSelected < m_selectedEntries.size()) {
+			index = m_selectedEntries[m_nextSelected++];
+			m_chain->GetEntry(index);
+			hasOutput = true;
+		}
+	} else if (index.get() + 1 < firstEntry.get() + size.get()) {
 		++index;
 		m_chain->GetEntry(index);
-		return true;
-	} else return false;
+		hasOutput = true;
+	}
+
+	if (hasOutput) updateIOStats();
+	else reportIOStats();
+	return hasOutput;
+}
+
+
+RootTreeReader::~RootTreeReader() {
+	stopIOStats();
 }
 
 
 
 TTree* RootTreeWriter::newTree(TDirectory *directory) {
 	TempChangeOfTDirectory outTDir(directory);
-	return new TTree(treeName.get().c_str(), treeTitle.get().c_str());
+	TTree *tree = new TTree(treeName.get().c_str(), treeTitle.get().c_str());
+	tree->SetAutoFlush(autoFlush);
+	tree->SetAutoSave(autoSave);
+	return tree;
+}
+
+
+TBranch* RootTreeWriter::createBranch(TTree *tree, const Value& value, const std::string& branchName) {
+	Int_t branchBufferSize = bufferSize;
+	Int_t branchSplitLevel = splitLevel;
+	Int_t branchCompression = compression;
+
+	const PropVal &overrides = branchSettings.get();
+	if (!overrides.isNone() && overrides.contains(branchName)) {
+		for (const auto &setting: overrides[branchName].asProps()) {
+			const string key = setting.first.toString();
+			if (key == "bufferSize") branchBufferSize = setting.second.asInt32();
+			else if (key == "splitLevel") branchSplitLevel = setting.second.asInt32();
+			else if (key == "compression") branchCompression = setting.second.asInt32();
+			else throw invalid_argument("Unknown setting \"%s\" for branch \"%s\" in bric \"%s\""_format(key, branchName, absolutePath()));
+		}
+	}
+
+	TBranch *branch = RootIO::outputValueTo(value, tree, branchName, branchBufferSize, branchSplitLevel);
+	if (branchCompression >= 0) branch->SetCompressionSettings(branchCompression);
+	return branch;
 }
 
 
@@ -114,23 +709,173 @@ void RootTreeWriter::Entry::disconnectInputs() {
 }
 
 
-void RootTreeWriter::Entry::createOutputBranches(TTree *tree) {
+std::vector< std::pair<std::string, const Bric::InputTerminal*> > RootTreeWriter::Entry::branchInputs() const {
 	std::map<std::string, const InputTerminal*> sortedInputs;
 	for (const auto &in: inputs()) sortedInputs[in.first.toString()] = in.second;
-	for (const auto &in: sortedInputs) {
+	return std::vector< std::pair<std::string, const InputTerminal*> >(sortedInputs.begin(), sortedInputs.end());
+}
+
+
+void RootTreeWriter::Entry::createOutputBranches(TTree *tree) {
+	for (const auto &in: branchInputs()) {
 		const string& branchName = in.first;
 		const InputTerminal* branchInput = in.second;
 		dbrx_log_trace("Creating output branch \"%s\" for input \"%s\" of \"%s\"", branchName, branchInput->name(), absolutePath());
-		RootIO::outputValueTo(branchInput->value(), tree, branchName);
+		m_writer->createBranch(tree, branchInput->value(), branchName);
 	}
 }
 
 
+void RootTreeWriter::Entry::createOutputBranches(TTree *tree, const std::vector< std::unique_ptr<PrimaryValue> > &values) {
+	auto inputs = branchInputs();
+	assert(values.size() == inputs.size());
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		dbrx_log_trace("Creating output branch \"%s\" for snapshot of input \"%s\" of \"%s\"", inputs[i].first, inputs[i].second->name(), absolutePath());
+		m_writer->createBranch(tree, *values[i], inputs[i].first);
+	}
+}
+
+
+void RootTreeWriter::Entry::newSnapshot(std::vector< std::unique_ptr<PrimaryValue> > &values) const {
+	values.clear();
+	for (const auto &in: branchInputs()) values.push_back(in.second->createMatchingValue());
+}
+
+
+void RootTreeWriter::Entry::takeSnapshot(std::vector< std::unique_ptr<PrimaryValue> > &values) const {
+	size_t i = 0;
+	for (const auto &in: branchInputs()) values[i++]->assign(in.second->value());
+}
+
+
 RootTreeWriter::Entry::Entry(RootTreeWriter *writer, PropKey entryName)
 	: DynInputGroup(writer, entryName), m_writer(writer) {}
 
 
+void RootTreeWriter::runFillHooks() {
+	for (auto &hook: m_fillHooks) hook.second();
+}
+
+
+void RootTreeWriter::fillTrees() {
+	for (auto tree: m_trees) {
+		dbrx_log_trace("Filling output tree \"%s/%s\" of \"%s\"", tree->GetDirectory()->GetPath(), tree->GetName(), absolutePath());
+		Long64_t flushedBytes = tree->GetFlushedBytes();
+		tree->Fill();
+
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+			// Hand each flushed cluster in a TBufferMerger file over to the merger:
+			if (tree->GetFlushedBytes() != flushedBytes) {
+				auto mergerFile = dynamic_cast<TBufferMergerFile*>(tree->GetCurrentFile());
+				if (mergerFile != nullptr) mergerFile->Write();
+			}
+		#endif
+	}
+
+	if (flushInterval > 0) {
+		auto now = chrono::steady_clock::now();
+		if (chrono::duration<double>(now - m_lastFlush).count() >= flushInterval) {
+			flushTrees();
+			m_lastFlush = now;
+		}
+	}
+}
+
+
+void RootTreeWriter::flushTrees() {
+	for (auto tree: m_trees) {
+		dbrx_log_trace("Saving output tree \"%s/%s\" of \"%s\"", tree->GetDirectory()->GetPath(), tree->GetName(), absolutePath());
+		tree->AutoSave("SaveSelf;FlushBaskets");
+
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+			auto mergerFile = dynamic_cast<TBufferMergerFile*>(tree->GetCurrentFile());
+			if (mergerFile != nullptr) mergerFile->Write();
+		#endif
+	}
+}
+
+
+void RootTreeWriter::startFillThread() {
+	#if ROOT_VERSION_CODE >= ROOT_VERSION(6,4,0)
+		ROOT::EnableThreadSafety();
+	#endif
+
+	entry.newSnapshot(m_stagedValues);
+	entry.newSnapshot(m_fillValues);
+
+	// Object values can be handed over by swapping pointers, as branches
+	// refer to the value pointer. Primitive branches refer to the content
+	// directly, so their values have to be copied.
+	m_swapStaged.clear();
+	for (const auto &value: m_fillValues)
+		m_swapStaged.push_back(TDataType::GetType(value->typeInfo()) == kOther_t);
+
+	m_entryStaged = false;
+	m_stopFill = false;
+	m_fillError = nullptr;
+	m_fillThread = std::thread(&RootTreeWriter::fillThreadLoop, this);
+}
+
+
+void RootTreeWriter::fillThreadLoop() {
+	try {
+		while (true) {
+			{
+				unique_lock<mutex> lock(m_fillMutex);
+				m_fillCond.wait(lock, [this]{ return m_entryStaged || m_stopFill; });
+				if (!m_entryStaged) break;
+				for (size_t i = 0; i < m_fillValues.size(); ++i) {
+					if (m_swapStaged[i]) swap(*m_fillValues[i], *m_stagedValues[i]);
+					else m_fillValues[i]->assign(*m_stagedValues[i]);
+				}
+				m_entryStaged = false;
+			}
+			m_fillCond.notify_all();
+
+			runFillHooks();
+			lock_guard<mutex> treesLock(m_treesMutex);
+			fillTrees();
+		}
+	} catch (...) {
+		lock_guard<mutex> lock(m_fillMutex);
+		m_fillError = current_exception();
+		m_entryStaged = false;
+	}
+	m_fillCond.notify_all();
+}
+
+
+void RootTreeWriter::stopFillThread(bool rethrow) {
+	if (!m_fillThread.joinable()) return;
+
+	{
+		lock_guard<mutex> lock(m_fillMutex);
+		m_stopFill = true;
+	}
+	m_fillCond.notify_all();
+	m_fillThread.join();
+
+	exception_ptr fillError = m_fillError;
+	m_fillError = nullptr;
+	if (rethrow && fillError) rethrow_exception(fillError);
+}
+
+
 void RootTreeWriter::newReduction() {
+	stopFillThread();
+
+	if (implicitMT) {
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+			if (!ROOT::IsImplicitMTEnabled()) ROOT::EnableImplicitMT();
+		#else
+			dbrx_log_warn("ROOT version does not support implicit multi-threading, ignoring implicitMT in bric \"%s\"", absolutePath());
+		#endif
+	}
+
+	if (async) startFillThread();
+
+	m_lastFlush = chrono::steady_clock::now();
+
 	// Dummy output tree:
 	output.value() = unique_ptr<TTree>(newTree(localTDirectory()));
 
@@ -140,21 +885,88 @@ void RootTreeWriter::newReduction() {
 		TDirectory* targetDirectory = getDir();
 		dbrx_log_debug("Creating new TTree \"%s\" as output of bric \"%s\" in TDirectory \"%s\" ", treeName.get(), absolutePath(), targetDirectory->GetPath());
 		TTree* tree = newTree(targetDirectory);
-		entry.createOutputBranches(tree);
+		if (async) entry.createOutputBranches(tree, m_fillValues);
+		else entry.createOutputBranches(tree);
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+			if (implicitMT) tree->SetImplicitMT(true);
+		#endif
 		m_trees.push_back(tree);
 	}
 }
 
 
 void RootTreeWriter::processInput() {
-	for (auto tree: m_trees) {
-		dbrx_log_trace("Filling output tree \"%s/%s\" of \"%s\"", tree->GetDirectory()->GetPath(), tree->GetName(), absolutePath());
-		tree->Fill();
+	if (m_fillThread.joinable()) {
+		// Wait for fill thread to take over the previous entry:
+		unique_lock<mutex> lock(m_fillMutex);
+		m_fillCond.wait(lock, [this]{ return !m_entryStaged || m_fillError; });
+		if (m_fillError) {
+			// Rethrows the exception from the fill thread:
+			lock.unlock();
+			stopFillThread();
+		}
+		entry.takeSnapshot(m_stagedValues);
+		m_entryStaged = true;
+		lock.unlock();
+		m_fillCond.notify_all();
+	} else {
+		runFillHooks();
+		fillTrees();
 	}
 }
 
 
+void RootTreeWriter::setFillHook(const Bric *consumer, std::function<void()> hook) {
+	auto found = find_if(m_fillHooks.begin(), m_fillHooks.end(),
+		[consumer](const std::pair<const Bric*, std::function<void()>> &entry) { return entry.first == consumer; });
+	if (!hook) {
+		if (found != m_fillHooks.end()) m_fillHooks.erase(found);
+	} else if (found != m_fillHooks.end()) {
+		found->second = std::move(hook);
+	} else {
+		m_fillHooks.push_back({consumer, std::move(hook)});
+	}
+}
+
+
+void RootTreeWriter::changeOutputDirs() {
+	for (size_t i = 0; i < m_trees.size(); ++i) {
+		TTree *tree = m_trees[i];
+		TDirectory *directory = m_outputDirProviders[i]();
+		if (tree->GetDirectory() == directory) continue;
+
+		dbrx_log_debug("Moving output tree \"%s\" of bric \"%s\" to TDirectory \"%s\"", tree->GetName(), absolutePath(), directory->GetPath());
+		// Same as TTree::ChangeFile: drop entries and baskets already written
+		// to the previous file, keep branches and their addresses:
+		tree->Reset();
+		tree->SetDirectory(directory);
+	}
+}
+
+
+void RootTreeWriter::releaseFillValues() {
+	if (m_fillValues.empty()) return;
+
+	// Output branches of async trees refer to the fill values, and the
+	// trees are only written later on (by RootFileWriter):
+	{
+		lock_guard<mutex> treesLock(m_treesMutex);
+		for (auto tree: m_trees) tree->ResetBranchAddresses();
+	}
+
+	m_stagedValues.clear();
+	m_fillValues.clear();
+}
+
+
 void RootTreeWriter::finalizeReduction() {
+	stopFillThread();
+	releaseFillValues();
+}
+
+
+RootTreeWriter::~RootTreeWriter() {
+	stopFillThread(false);
 }
 
 
@@ -175,16 +987,39 @@ RootFileReader::ContentGroup& RootFileReader::ContentGroup::subGroup(PropKey nam
 }
 
 
+void RootFileReader::ContentGroup::releaseOutputValue(OutputTerminal &output) {
+	if (output.value().empty()) return;
+
+	auto reusedFound = m_outputKeys.find(&output);
+	if (reusedFound != m_outputKeys.end()) {
+		// Objects read for reuse are owned by us:
+		m_outputKeys.erase(reusedFound);
+		output.value().clear();
+	} else if (output.value().isPtrAssignableTo(typeid(AbstractWrappedTObj))) {
+		AbstractWrappedTObj *outputWrappedTObj = output.value().typedPtr<AbstractWrappedTObj>();
+		outputWrappedTObj->releaseTObj().release();
+	} else {
+		output.value().untypedRelease();
+	}
+}
+
+
 void RootFileReader::ContentGroup::releaseOutputValues() {
-	for (auto &elem: m_outputs) if (! elem.second->value().empty()) {
-		if (elem.second->value().isPtrAssignableTo(typeid(AbstractWrappedTObj))) {
-			AbstractWrappedTObj *outputWrappedTObj = elem.second->value().typedPtr<AbstractWrappedTObj>();
-			outputWrappedTObj->releaseTObj().release();
-		} else {
-			OutputTerminal &output = *elem.second;
-			output.value().untypedRelease();
-		}
+	for (auto &elem: m_outputs) releaseOutputValue(*elem.second);
+}
+
+
+void RootFileReader::ContentGroup::indexKeys() {
+	m_keyIndex.clear();
+	TList *keys = m_inputDir->GetListOfKeys();
+	if (keys == nullptr) return;
+	TIter next(keys);
+	while (TKey *key = dynamic_cast<TKey*>(next())) {
+		// Keep the highest cycle for each name:
+		TKey* &indexed = m_keyIndex[key->GetName()];
+		if ((indexed == nullptr) || (key->GetCycle() > indexed->GetCycle())) indexed = key;
 	}
+	dbrx_log_trace("Indexed %s keys in \"%s\" for content group \"%s\"", m_keyIndex.size(), m_inputDir->GetPath(), absolutePath());
 }
 
 
@@ -198,11 +1033,12 @@ void RootFileReader::ContentGroup::addDynOutput(std::unique_ptr<Bric::OutputTerm
 
 
 void RootFileReader::ContentGroup::readObjects() {
-	// Release output values, they're either empty or we don't really own them:
-	releaseOutputValues();
+	// Release output values, they're either empty or we don't really own them.
+	// Reusable objects are kept until their key changes:
+	if (!m_reader->reuseUnchanged) releaseOutputValues();
 
 	if (isTopGroup()) {
-		m_inputDir = m_reader->m_inputFile.get();
+		m_inputDir = m_reader->inputFile();
 	} else {
 		TDirectory *parentInputDir = dynamic_cast<ContentGroup&>(parent()).m_inputDir;
 		dbrx_log_trace("Looking up sub-directory \"%s\" inside \"%s\" for content group \"%s\" "_format(name(), parentInputDir->GetPath(), absolutePath()));
@@ -210,11 +1046,51 @@ void RootFileReader::ContentGroup::readObjects() {
 		if (m_inputDir == nullptr) throw runtime_error("Could not find sub-directory \"%s\" in TDirectory \"%s\""_format(name(), parentInputDir->GetPath()));
 	}
 
+	if (m_reader->reuseUnchanged) indexKeys();
+
 	for (auto &elem: m_outputs) {
 		OutputTerminal &output = *elem.second;
-		dbrx_log_trace("Reading object \"%s\" from \"%s\" in content group \"%s\"", output.name(), m_inputDir->GetPath(), absolutePath());
-		TObject *obj = m_inputDir->Get(output.name().toString().c_str());
-		if (obj == nullptr) throw runtime_error("Could not read object \"%s\" from TDirectory \"%s\""_format(output.name(), m_inputDir->GetPath()));
+		TObject *obj = nullptr;
+		bool readForReuse = false;
+
+		if (m_reader->reuseUnchanged) {
+			auto found = m_keyIndex.find(output.name().toString());
+			if (found == m_keyIndex.end()) throw runtime_error("Could not find object \"%s\" in TDirectory \"%s\""_format(output.name(), m_inputDir->GetPath()));
+			TKey *key = found->second;
+
+			// TTrees stay attached to the input file, everything else is only
+			// deserialized again if read from a different key:
+			TClass *keyClass = TClass::GetClass(key->GetClassName());
+			if ((keyClass == nullptr) || !keyClass->InheritsFrom(TTree::Class())) {
+				// File UUID and key date distinguish rewritten files with the
+				// same layout (e.g. output of a RootFileWriter read again):
+				TFile *inputFile = m_reader->inputFile();
+				string keyId = "%s/%s;%s@%s %s %s"_format(inputFile->GetName(), key->GetName(), key->GetCycle(), key->GetSeekKey(), key->GetDatime().Get(), inputFile->GetUUID().AsString());
+				auto loaded = m_outputKeys.find(&output);
+				if ((loaded != m_outputKeys.end()) && (loaded->second == keyId) && !output.value().empty()) {
+					dbrx_log_trace("Object \"%s\" in content group \"%s\" unchanged, not reading it again", output.name(), absolutePath());
+					continue;
+				}
+				releaseOutputValue(output);
+				dbrx_log_trace("Reading object \"%s\" from key in \"%s\" in content group \"%s\"", output.name(), m_inputDir->GetPath(), absolutePath());
+				obj = key->ReadObj();
+				if (obj == nullptr) throw runtime_error("Could not read object \"%s\" from TDirectory \"%s\""_format(output.name(), m_inputDir->GetPath()));
+
+				// Detach obj from input directory, so it can outlive the input file:
+				auto autoAddFunc = obj->IsA()->GetDirectoryAutoAdd();
+				if (autoAddFunc) autoAddFunc(obj, nullptr);
+				m_outputKeys[&output] = keyId;
+				readForReuse = true;
+			} else {
+				releaseOutputValue(output);
+			}
+		}
+
+		if (obj == nullptr) {
+			dbrx_log_trace("Reading object \"%s\" from \"%s\" in content group \"%s\"", output.name(), m_inputDir->GetPath(), absolutePath());
+			obj = m_inputDir->Get(output.name().toString().c_str());
+			if (obj == nullptr) throw runtime_error("Could not read object \"%s\" from TDirectory \"%s\""_format(output.name(), m_inputDir->GetPath()));
+		}
 
 		TypeReflection outputType(output.value().typeInfo());
 		TypeReflection objectType(obj->IsA());
@@ -223,19 +1099,23 @@ void RootFileReader::ContentGroup::readObjects() {
 			if (output.value().empty()) output.value().setToDefault();
 			AbstractWrappedTObj *outputWrappedTObj = output.value().typedPtr<AbstractWrappedTObj>();
 			if (outputWrappedTObj->canWrapTObj(obj) ) {
-				// Wrap output value around obj - obj is really owned by input
-				// TFile, not by us, so we'll have to release it again later:
+				// Wrap output value around obj - unless read for reuse, obj is
+				// really owned by input TFile, not by us, so we'll have to
+				// release it again later:
 				outputWrappedTObj->wrapTObj(unique_ptr<TObject>(obj));
 			} else {
+				if (readForReuse) { m_outputKeys.erase(&output); delete obj; }
 				TypeReflection outputWrappedType(outputWrappedTObj->typeInfo());
 				throw logic_error("Wrapped type %s of WrappedTObj output terminal \"%s\" is incompatible with type %s of object \"%s\" read from \"%s\""_format(outputWrappedType.name(), output.absolutePath(), objectType.name(), output.name(), m_inputDir->GetPath()));				
 			}
 		} else {
 			if (outputType.isPtrAssignableFrom(objectType) ) {
-				// Point output value to obj - obj is really owned by input
-				// TFile, not by us, so we'll have to release it again later:
+				// Point output value to obj - unless read for reuse, obj is
+				// really owned by input TFile, not by us, so we'll have to
+				// release it again later:
 				output.value().untypedOwn(obj);
 			} else {
+				if (readForReuse) { m_outputKeys.erase(&output); delete obj; }
 				throw logic_error("Type %s of output terminal \"%s\" is incompatible with type %s of object \"%s\" read from \"%s\""_format(outputType.name(), output.absolutePath(), objectType.name(), output.name(), m_inputDir->GetPath()));
 			}
 		}
@@ -250,14 +1130,29 @@ RootFileReader::ContentGroup::ContentGroup(RootFileReader *reader, Bric *parentB
 
 
 RootFileReader::ContentGroup::~ContentGroup() {
-	// Release output values, they're either empty or we don't really own them:
+	// Release output values, they're either empty, read for reuse and owned by
+	// us, or we don't really own them:
 	releaseOutputValues();
 }
 
 
 void RootFileReader::processInput() {
-	dbrx_log_debug("Opening TFile \"%s\" for read in bric \"%s\""_format(input->c_str(), absolutePath()));
-	m_inputFile = unique_ptr<TFile>(new TFile(input->c_str(), "read"));
+	m_sharedInputFile = nullptr;
+	if (!input.hasFixedValue() && (input.srcTerminal() != nullptr)) {
+		auto constFileWriter = dynamic_cast<const RootFileWriter*>(&input.srcTerminal()->parent());
+		if (constFileWriter != nullptr) {
+			// TODO: Find a way to eliminate this const_cast:
+			m_sharedInputFile = const_cast<RootFileWriter*>(constFileWriter)->sharedOutputFile();
+		}
+	}
+
+	if (m_sharedInputFile != nullptr) {
+		dbrx_log_debug("Using open TFile \"%s\" of bric \"%s\" for read in bric \"%s\""_format(m_sharedInputFile->GetName(), input.srcTerminal()->parent().absolutePath(), absolutePath()));
+		m_inputFile.reset();
+	} else {
+		dbrx_log_debug("Opening TFile \"%s\" for read in bric \"%s\""_format(input->c_str(), absolutePath()));
+		m_inputFile = unique_ptr<TFile>(new TFile(input->c_str(), "read"));
+	}
 	content.readObjects();
 }
 
@@ -283,11 +1178,24 @@ void RootFileWriter::ContentGroup::connectInputs() {
 		if (constTDirOutBric) {
 			// TODO: Find a way to eliminate this const_cast:
 			auto tdirOutBric = const_cast<RootTreeWriter*>(constTDirOutBric);
+			auto &treeWriters = m_writer->m_treeWriters;
+			if (find(treeWriters.begin(), treeWriters.end(), tdirOutBric) == treeWriters.end())
+				treeWriters.push_back(tdirOutBric);
+
+			// Only needed for rollover and periodic flushing, keep the fill
+			// path free of our output lock otherwise (and with TBufferMerger,
+			// which supports neither):
+			RootFileWriter *writer = m_writer;
+			if ((writer->rolloverEnabled() || writer->periodicFlush()) && !writer->bufferMerger)
+				tdirOutBric->setFillHook(writer, [writer]() { writer->beforeTreeFill(); });
+			else
+				tdirOutBric->setFillHook(writer, nullptr);
 
 			dbrx_log_trace("trigger Adding TDirectory of bric \"%s\" to output directories of bric \"%s\"", absolutePath(), tdirOutBric->absolutePath());
 			tdirOutBric->addOutputDirProvider([&]() {
 				m_writer->openOutputForWrite();
-				return m_outputDir;
+				// With TBufferMerger, each tree gets an in-memory file of its own:
+				return m_writer->m_mergedOutput ? newMergedOutputDir() : m_outputDir;
 			} );
 		}
 
@@ -323,6 +1231,15 @@ RootFileWriter::ContentGroup& RootFileWriter::ContentGroup::subGroup(PropKey nam
 }
 
 
+TDirectory* RootFileWriter::ContentGroup::newMergedOutputDir() {
+	if (isTopGroup()) return m_writer->newMergedOutputFile();
+
+	TDirectory* parentOutputDir = dynamic_cast<ContentGroup&>(parent()).newMergedOutputDir();
+	string subDirName = name().toString();
+	return parentOutputDir->mkdir(subDirName.c_str(), subDirName.c_str());
+}
+
+
 void RootFileWriter::ContentGroup::processInput() {
 	TempChangeOfTDirectory tDirChange(m_outputDir);
 
@@ -348,7 +1265,7 @@ void RootFileWriter::ContentGroup::processInput() {
 					// Need to clone inputObject to own it:
 					dbrx_log_trace("Cloning object \"%s\" to content group \"%s\"", inputObject->GetName(), absolutePath());
 					TNamed *outputObject = (TNamed*) inputObject->Clone();
-					writeObject(outputObject);
+					writeObject(outputObject, m_writer->periodicFlush());
 				}
 			}
 		}
@@ -396,11 +1313,11 @@ void RootFileWriter::ContentGroup::addContent(const PropPath &sourcePath) {
 }
 
 
-void RootFileWriter::ContentGroup::newOutput() {
+void RootFileWriter::ContentGroup::newOutput(TDirectory *outputFile) {
 	for (auto &entry: m_sourceInfos) { entry.second.inputCounter = 0; }
 
 	if (isTopGroup()) {
-		m_outputDir = m_writer->outputFile.value().ptr();
+		m_outputDir = outputFile;
 	} else {
 		TDirectory* parentOutputDir = dynamic_cast<ContentGroup&>(parent()).m_outputDir;
 
@@ -411,7 +1328,7 @@ void RootFileWriter::ContentGroup::newOutput() {
 		m_outputDir = parentOutputDir->mkdir(subDirName, subDirName);
 	}
 
-	for (auto &entry: m_brics) dynamic_cast<ContentGroup*>(entry.second)->newOutput();
+	for (auto &entry: m_brics) dynamic_cast<ContentGroup*>(entry.second)->newOutput(outputFile);
 }
 
 
@@ -420,7 +1337,29 @@ RootFileWriter::ContentGroup::ContentGroup(RootFileWriter *writer, Bric *parentB
 
 
 
-void RootFileWriter::writeObject(TNamed *obj) {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+struct RootFileWriter::MergedOutput {
+	unique_ptr<TBufferMerger> merger;
+	vector< shared_ptr<TBufferMergerFile> > files;
+};
+#else
+struct RootFileWriter::MergedOutput {};
+#endif
+
+
+TDirectory* RootFileWriter::newMergedOutputFile() {
+	#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+		shared_ptr<TBufferMergerFile> file = m_mergedOutput->merger->GetFile();
+		if (compression >= 0) file->SetCompressionSettings(compression);
+		m_mergedOutput->files.push_back(file);
+		return file.get();
+	#else
+		throw logic_error("TBufferMerger not supported by this ROOT version");
+	#endif
+}
+
+
+void RootFileWriter::writeObject(TNamed *obj, bool replacePrevious) {
 	if (string(obj->GetName()).empty())
 		throw invalid_argument("Refusing to add object with empty name to TDirectory");
 
@@ -431,12 +1370,26 @@ void RootFileWriter::writeObject(TNamed *obj) {
 		TDirectory::AddDirectoryStatus() && (obj->IsA()->GetDirectoryAutoAdd() != nullptr)
 	);
 
-	if (!autoAdded) obj->Write();
+	if (autoAdded) {
+		if (replacePrevious) {
+			// Keep only the latest snapshot in memory, obj was appended last:
+			TList *objects = gDirectory->GetList();
+			TObject *previous = nullptr;
+			while (((previous = objects->FindObject(obj->GetName())) != nullptr) && (previous != obj)) {
+				objects->Remove(previous);
+				delete previous;
+			}
+		}
+	} else {
+		obj->Write(nullptr, replacePrevious ? TObject::kOverwrite : 0);
+		delete obj;
+	}
 }
 
 
 void RootFileWriter::connectInputs() {
 	dbrx_log_trace("Setting up content groups for bric \"%s\"", absolutePath());
+	m_treeWriters.clear();
 	inputs.addContent(content);
 
 	AsyncReducerBric::connectInputs();
@@ -444,18 +1397,112 @@ void RootFileWriter::connectInputs() {
 
 
 void RootFileWriter::newReduction() {
+	lock_guard<mutex> lock(m_outputMutex);
 	openOutputForWrite();
 }
 
 
 void RootFileWriter::processInput() {
+	lock_guard<mutex> lock(m_outputMutex);
 	inputs.processInput();
+
+	++m_inputsSinceFlush;
+	if (flushDue()) flushOutput();
+}
+
+
+void RootFileWriter::beforeTreeFill() {
+	lock_guard<mutex> lock(m_outputMutex);
+	// Checked before the entry is written, so that rollover never leaves an
+	// empty last file:
+	if (rolloverDue()) rolloverOutput();
+	else if (flushDue()) flushOutput();
+	++m_entriesInFile;
+	++m_inputsSinceFlush;
+}
+
+
+bool RootFileWriter::flushDue() {
+	if ((flushInputs > 0) && (m_inputsSinceFlush >= flushInputs)) return true;
+	if ((flushInterval > 0) && (chrono::duration<double>(chrono::steady_clock::now() - m_lastFlush).count() >= flushInterval)) return true;
+	return false;
+}
+
+
+void RootFileWriter::flushOutput() {
+	m_lastFlush = chrono::steady_clock::now();
+	m_inputsSinceFlush = 0;
+
+	if (!m_outputReadyForWrite || m_mergedOutput || inMemory) return;
+
+	// Trees may be filled asynchronously, have to wait until their
+	// writers are in between entries:
+	vector< unique_lock<mutex> > treeLocks;
+	for (auto treeWriter: m_treeWriters) treeLocks.push_back(treeWriter->lockTrees());
+
+	dbrx_log_debug("Flushing TFile \"%s\" in bric \"%s\""_format(outputFile->GetName(), absolutePath()));
+	outputFile->Write(nullptr, TObject::kOverwrite);
+	outputFile->Flush();
 }
 
 
 void RootFileWriter::finalizeReduction() {
+	lock_guard<mutex> lock(m_outputMutex);
 	finalizeOutput();
 	output = outputFile->GetName();
+	outputFileNames = m_outputFileNames;
+	m_fileIndex = 0;
+}
+
+
+string RootFileWriter::currentFileName() {
+	if (!rolloverEnabled()) return fileName;
+
+	string pattern = rolloverFileName;
+	if (pattern.empty()) {
+		pattern = fileName;
+		size_t extPos = pattern.rfind('.');
+		size_t dirPos = pattern.rfind('/');
+		if ((extPos == string::npos) || ((dirPos != string::npos) && (extPos < dirPos))) extPos = pattern.size();
+		pattern.insert(extPos, "_{n}");
+	}
+
+	size_t indexPos = pattern.find("{n}");
+	if (indexPos == string::npos)
+		throw invalid_argument("Rollover file name pattern \"%s\" of bric \"%s\" doesn't contain \"{n}\""_format(pattern, absolutePath()));
+
+	ostringstream index;
+	index << setw(4) << setfill('0') << m_fileIndex;
+	return pattern.replace(indexPos, 3, index.str());
+}
+
+
+bool RootFileWriter::rolloverDue() {
+	if (!m_outputReadyForWrite || m_mergedOutput || inMemory) return false;
+	if ((maxFileEntries > 0) && (m_entriesInFile >= maxFileEntries)) return true;
+	if ((maxFileSize > 0) && (outputFile->GetEND() >= maxFileSize)) return true;
+	return false;
+}
+
+
+void RootFileWriter::rolloverOutput() {
+	// Trees may be filled asynchronously, have to wait until their
+	// writers are in between entries:
+	vector< unique_lock<mutex> > treeLocks;
+	for (auto treeWriter: m_treeWriters) treeLocks.push_back(treeWriter->lockTrees());
+
+	unique_ptr<TFile> prevFile(outputFile.value().release());
+	dbrx_log_info("Rolling over from TFile \"%s\" after %s tree entries in bric \"%s\""_format(prevFile->GetName(), m_entriesInFile, absolutePath()));
+	prevFile->Write();
+
+	++m_fileIndex;
+	m_outputReadyForWrite = false;
+	openOutputForWrite();
+
+	// Trees continue in the new file, everything else left in the previous
+	// file is deleted when it's closed:
+	for (auto treeWriter: m_treeWriters) treeWriter->changeOutputDirs();
+	prevFile->Close();
 }
 
 
@@ -463,14 +1510,55 @@ void RootFileWriter::openOutputForWrite() {
 	// Legal to call when already open:
 	if (m_outputReadyForWrite) return;
 
-	const char *outFileName = fileName->c_str();
+	if (rolloverEnabled() && (bufferMerger || inMemory))
+		throw invalid_argument("Output file rollover is not supported with bufferMerger or inMemory in bric \"%s\""_format(absolutePath()));
+
+	string outFileNameStr = currentFileName();
+	const char *outFileName = outFileNameStr.c_str();
 	const char *outFileTitle = title->c_str();
-	dbrx_log_debug("Creating TFile \"%s\" with title \"%s\" in bric \"%s\""_format(outFileName, outFileTitle, absolutePath()));
-	TFile *tfile = TFile::Open(outFileName, "RECREATE", outFileTitle);
+
+	if (m_fileIndex == 0) m_outputFileNames.clear();
+	m_outputFileNames.push_back(outFileNameStr);
+
+	if (bufferMerger) {
+		#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+			dbrx_log_debug("Creating TBufferMerger for TFile \"%s\" in bric \"%s\""_format(outFileName, absolutePath()));
+			ROOT::EnableThreadSafety();
+			m_mergedOutput = make_shared<MergedOutput>();
+			m_mergedOutput->merger = (compression >= 0) ?
+				unique_ptr<TBufferMerger>(new TBufferMerger(outFileName, "RECREATE", compression)) :
+				unique_ptr<TBufferMerger>(new TBufferMerger(outFileName, "RECREATE"));
+
+			// Non-tree content goes into the first in-memory file:
+			outputFile.value().clear();
+			inputs.newOutput(newMergedOutputFile());
+
+			m_outputReadyForWrite = true;
+			return;
+		#else
+			throw runtime_error("Parameter bufferMerger of bric \"%s\" requires ROOT >= 6.10"_format(absolutePath()));
+		#endif
+	}
+
+	TFile *tfile = nullptr;
+	if (inMemory) {
+		// Previous disk copy must be complete before file is recreated:
+		waitForDiskCopy();
+		dbrx_log_debug("Creating TMemFile \"%s\" with title \"%s\" in bric \"%s\""_format(outFileName, outFileTitle, absolutePath()));
+		tfile = new TMemFile(outFileName, "RECREATE", outFileTitle);
+	} else {
+		dbrx_log_debug("Creating TFile \"%s\" with title \"%s\" in bric \"%s\""_format(outFileName, outFileTitle, absolutePath()));
+		tfile = TFile::Open(outFileName, "RECREATE", outFileTitle);
+	}
 	if (tfile == nullptr) throw runtime_error("Could not create TFile \"%s\""_format(outFileName));
+	if (compression >= 0) tfile->SetCompressionSettings(compression);
 	outputFile.value() = unique_ptr<TFile>(tfile);
 
-	inputs.newOutput();
+	inputs.newOutput(tfile);
+
+	m_lastFlush = chrono::steady_clock::now();
+	m_inputsSinceFlush = 0;
+	m_entriesInFile = 0;
 
 	m_outputReadyForWrite = true;
 }
@@ -480,17 +1568,67 @@ void RootFileWriter::finalizeOutput() {
 	// Legal to call when already closed:
 	if (! m_outputReadyForWrite) return;
 
+	#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+	if (m_mergedOutput) {
+		dbrx_log_debug("Merging in-memory files into TFile \"%s\" in bric \"%s\""_format(fileName.get(), absolutePath()));
+		for (auto &file: m_mergedOutput->files) file->Write();
+		// Destroying the merger waits until all queued buffers are written:
+		m_mergedOutput.reset();
+
+		TFile *tfile = TFile::Open(fileName->c_str(), "READ");
+		if (tfile == nullptr) throw runtime_error("Could not reopen merged TFile \"%s\""_format(fileName.get()));
+		outputFile.value() = unique_ptr<TFile>(tfile);
+
+		m_outputReadyForWrite = false;
+		return;
+	}
+	#endif
+
 	dbrx_log_debug("Writing TFile \"%s\" in bric \"%s\""_format(outputFile->GetName(), absolutePath()));
 	outputFile->Write();
 
-	outputFile->ReOpen("READ");
+	TMemFile *memFile = dynamic_cast<TMemFile*>(outputFile.value().ptr());
+	if (memFile != nullptr) {
+		// Take a snapshot of the file image, so that readers can use the
+		// TMemFile while the snapshot is being written to disk:
+		shared_ptr< vector<char> > image(new vector<char>(memFile->GetSize()));
+		memFile->CopyTo(image->data(), image->size());
+
+		string diskFileName = fileName;
+		dbrx_log_debug("Writing in-memory file \"%s\" (%s bytes) to disk asynchronously in bric \"%s\""_format(diskFileName, image->size(), absolutePath()));
+		m_diskCopy = async(launch::async, [image, diskFileName]() {
+			ofstream out(diskFileName, ios::binary | ios::trunc);
+			out.write(image->data(), image->size());
+			out.close();
+			if (!out) throw runtime_error("Failed to write in-memory file to \"%s\""_format(diskFileName));
+		});
+	} else {
+		outputFile->ReOpen("READ");
+	}
 
 	m_outputReadyForWrite = false;
 }
 
 
+TFile* RootFileWriter::sharedOutputFile() {
+	if ((shareOutput || inMemory) && !m_outputReadyForWrite && !outputFile.value().empty())
+		return outputFile.value().ptr();
+	else return nullptr;
+}
+
+
+void RootFileWriter::waitForDiskCopy() {
+	if (m_diskCopy.valid()) m_diskCopy.get();
+}
+
+
 RootFileWriter::~RootFileWriter() {
 	finalizeOutput();
+
+	try { waitForDiskCopy(); }
+	catch (const std::exception &e) {
+		dbrx_log_error("Writing output to disk failed in bric \"%s\": %s", absolutePath(), e.what());
+	}
 }
 
 
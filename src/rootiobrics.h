@@ -19,6 +19,13 @@
 #define DBRX_ROOTIOBRICS_H
 
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <unordered_map>
+#include <future>
+#include <chrono>
 
 #include "Bric.h"
 
@@ -26,37 +33,149 @@
 #include <TFile.h>
 #include <TTree.h>
 #include <TChain.h>
+#include <TKey.h>
+#include <TTreePerfStats.h>
 
 namespace dbrx {
 
 
+class RootChainBuilder: public ImportBric {
+protected:
+	static void expandGlob(const std::string &pattern, std::vector<std::string> &fileNames);
+
+	virtual std::vector<std::string> inputFileNames();
+
+	// Opens the given files in parallel and sets their entry counts
+	virtual void probeEntries(const std::vector<std::string> &fileNames, const std::vector<size_t> &indices, std::vector<Long64_t> &entries);
+
+public:
+	Param<std::vector<std::string>> files{this, "files", "Input file names or glob patterns"};
+	Param<std::string> fileList{this, "fileList", "Text file with additional input file names or glob patterns, one per line", ""};
+	Param<std::string> treeName{this, "treeName", "Name of the input trees", "tree"};
+	Param<int32_t> nThreads{this, "nThreads", "Number of threads for reading entry counts (0 for number of CPU cores)", 0};
+	Param<std::string> entryCountCache{this, "entryCountCache", "JSON file to cache entry counts in, by file path, size and modification time (empty to disable)", ""};
+
+	Output<TChain> output{this, "", "Chain of input trees"};
+
+	void import() override;
+
+	using ImportBric::ImportBric;
+};
+
+
+
 class RootTreeReader: public MapperBric {
 protected:
 	std::unique_ptr<TChain> m_chain;
 
+	Int_t m_columnsTreeNumber = -1;
+	Long64_t m_nextEntry = 0;
+
+	bool m_sparse = false;
+	std::vector<int64_t> m_selectedEntries;
+	size_t m_nextSelected = 0;
+	std::vector<Long64_t> m_batchLocalEntries;
+
+	virtual bool hasEntrySelection();
+	virtual void loadEntrySelection();
+	virtual void readEntryListFile(const std::string &fileName, std::vector<int64_t> &entries);
+
+	virtual Long64_t loadColumnsTree(Long64_t entry);
+	virtual bool nextColumnBatch();
+
+	// Compressed-size bookkeeping for a connected (leaf) branch
+	struct BranchIOStats {
+		std::string name;
+		TBranch* branch = nullptr;
+		Int_t lastBasket = -1;
+		size_t nBaskets = 0;
+		Long64_t zipBytes = 0;
+	};
+
+	std::unique_ptr<TTreePerfStats> m_perfStats;
+	std::vector<BranchIOStats> m_branchIOStats;
+	Int_t m_ioStatsTreeNumber = -1;
+	bool m_ioStatsReported = false;
+
+	virtual std::vector<TBranch*> connectedBranches(TTree* tree);
+	virtual Long64_t autoCacheSizeFor(TTree* tree);
+
+	virtual void startIOStats();
+	virtual void updateIOStats();
+	virtual void reportIOStats();
+	virtual void stopIOStats();
+
 public:
 	class Entry final: public DynOutputGroup {
+	protected:
+		// Reads a primitive branch basket-wise into a contiguous column
+		class Column {
+		protected:
+			std::string m_branchName;
+			TBranch* m_branch = nullptr;
+
+		public:
+			const std::string& branchName() const { return m_branchName; }
+
+			virtual void attachTo(TTree* tree) = 0;
+
+			// First entry (local to current tree) after the basket containing localEntry
+			virtual Long64_t basketEnd(Long64_t localEntry) const final;
+
+			virtual void readEntries(Long64_t from, Long64_t until) = 0;
+			virtual void readEntries(const std::vector<Long64_t> &localEntries) = 0;
+
+			Column(std::string branchName): m_branchName(std::move(branchName)) {}
+			virtual ~Column() {}
+		};
+
+		template<typename T> class TypedColumn;
+
+		std::vector< std::unique_ptr<Column> > m_columns;
+
+		static std::unique_ptr<Column> newColumn(OutputTerminal& terminal);
+
 	public:
 		void connectBranches(Bric* contextBric, TTree* inputTree);
+
+		void connectColumns(Bric* contextBric, TTree* inputTree);
+		void attachColumns(TTree* currentTree);
+		Long64_t columnsBasketEnd(Long64_t localEntry) const;
+		void readColumns(Long64_t from, Long64_t until);
+		void readColumns(const std::vector<Long64_t> &localEntries);
+
 		using DynOutputGroup::DynOutputGroup;
 	};
 
 	Input<TTree> input{this};
 
+	Input<std::vector<int64_t>> entryList{this, "entryList", "Entries to read, overrides contiguous entry range if connected or non-empty", std::vector<int64_t>()};
+
 	Param<int64_t> cacheSize{this, "cacheSize", "Input read-ahead cache size (-1 for default)", -1};
+	Param<bool> autoCacheSize{this, "autoCacheSize", "Size read-ahead cache from compressed cluster size of connected branches (overrides cacheSize)", false};
+	Param<int64_t> cacheMemBudget{this, "cacheMemBudget", "Upper limit for automatic read-ahead cache size", 256 * 1024 * 1024};
+	Param<int64_t> cacheLearnEntries{this, "cacheLearnEntries", "Number of entries for cache to learn branch access pattern (0 for ROOT default)", 0};
+	Param<bool> ioStats{this, "ioStats", "Collect I/O statistics and log them after last entry", false};
 	Param<int64_t> nEntries{this, "nEntries", "Number of entries to read (-1 for all)", -1};
 	Param<int64_t> firstEntry{this, "firstEntry", "First entry to read", 0};
 
+	Param<std::string> entryListFile{this, "entryListFile", "File with entries to read (\"FILE.root:NAME\" for a TEntryList, JSON array or plain text otherwise)", ""};
+
+	Param<bool> columnar{this, "columnar", "Read entries basket-wise, entry outputs are column batches of type std::vector<Int_t/Float_t/Double_t>", false};
+	Param<int64_t> batchSize{this, "batchSize", "Maximum number of entries per column batch (-1 for whole baskets)", -1};
+
 	Entry entry{this, "entry"};
 
 	Output<ssize_t> size{this, "size", "Number of entries"};
 	Output<ssize_t> index{this, "index", "Number of entries"};
+	Output<ssize_t> batchEntries{this, "batchEntries", "Number of entries in current column batch"};
 
 	void processInput() override;
 
 	bool nextOutput() override;
 
 	using MapperBric::MapperBric;
+	~RootTreeReader();
 };
 
 
@@ -66,8 +185,45 @@ protected:
 	std::vector< std::function<TDirectory*()> > m_outputDirProviders;
 	std::vector< TTree* > m_trees;
 
+	// Async mode: processInput snapshots the entry into m_stagedValues, the
+	// fill thread moves it into m_fillValues (bound to the output branches)
+	// and fills the trees, while the next entry is being staged.
+	std::vector< std::unique_ptr<PrimaryValue> > m_stagedValues;
+	std::vector< std::unique_ptr<PrimaryValue> > m_fillValues;
+	std::vector<bool> m_swapStaged;
+	std::thread m_fillThread;
+	std::mutex m_fillMutex;
+	std::condition_variable m_fillCond;
+	bool m_entryStaged = false;
+	bool m_stopFill = false;
+	std::exception_ptr m_fillError;
+
+	// Held while filling, so that output files of the trees can be written
+	// by others in between entries:
+	std::mutex m_treesMutex;
+
+	std::chrono::steady_clock::time_point m_lastFlush;
+
+	// Hooks of consumers (e.g. for output file rollover), called before each
+	// fill with the trees unlocked, in the fill thread in async mode:
+	std::vector< std::pair<const Bric*, std::function<void()>> > m_fillHooks;
+
 	TTree* newTree(TDirectory *directory);
 
+	virtual TBranch* createBranch(TTree *tree, const Value& value, const std::string& branchName);
+
+	virtual void runFillHooks();
+	virtual void fillTrees();
+	virtual void flushTrees();
+
+	virtual void startFillThread();
+	virtual void fillThreadLoop();
+	virtual void stopFillThread(bool rethrow = true);
+
+	// Detaches output branches of async trees from the fill values and
+	// frees the values
+	virtual void releaseFillValues();
+
 public:
 	class Entry final: public DynInputGroup {
 	protected:
@@ -83,7 +239,13 @@ public:
 
 		void processInput() override {}
 
+		std::vector< std::pair<std::string, const InputTerminal*> > branchInputs() const;
+
 		void createOutputBranches(TTree *tree);
+		void createOutputBranches(TTree *tree, const std::vector< std::unique_ptr<PrimaryValue> > &values);
+
+		void newSnapshot(std::vector< std::unique_ptr<PrimaryValue> > &values) const;
+		void takeSnapshot(std::vector< std::unique_ptr<PrimaryValue> > &values) const;
 
 		Entry() {}
 		Entry(RootTreeWriter *writer, PropKey entryName);
@@ -92,11 +254,31 @@ public:
 	virtual void addOutputDirProvider(std::function<TDirectory*()> provider)
 		{ m_outputDirProviders.push_back(std::move(provider)); }
 
+	// Replaces an existing hook of the same consumer, an empty hook removes it
+	virtual void setFillHook(const Bric *consumer, std::function<void()> hook);
+
+	std::unique_lock<std::mutex> lockTrees() { return std::unique_lock<std::mutex>(m_treesMutex); }
+
+	// Moves trees whose output directory has changed (e.g. on file
+	// rollover) to the new directory, trees must be locked and written
+	virtual void changeOutputDirs();
+
 	Entry entry{this, "entry"};
 
 	Param<std::string> treeName{this, "treeName", "Tree Name", "tree"};
 	Param<std::string> treeTitle{this, "treeTitle", "Tree Title", ""};
 
+	Param<int32_t> bufferSize{this, "bufferSize", "Branch buffer (basket) size in bytes", 32000};
+	Param<int32_t> splitLevel{this, "splitLevel", "Split level for object branches", 99};
+	Param<int32_t> compression{this, "compression", "Branch compression settings (100 * algorithm + level, -1 to use file settings)", -1};
+	Param<int64_t> autoFlush{this, "autoFlush", "Flush baskets every n entries if > 0, every -n bytes if < 0, never if 0", -30000000};
+	Param<int64_t> autoSave{this, "autoSave", "Save tree header every n entries if > 0, every -n bytes if < 0, never if 0", -300000000};
+	Param<PropVal> branchSettings{this, "branchSettings", "Per-branch overrides of bufferSize, splitLevel and compression, by branch name", Props()};
+
+	Param<bool> async{this, "async", "Fill output trees in a background thread", false};
+	Param<bool> implicitMT{this, "implicitMT", "Compress baskets using ROOT implicit multi-threading", false};
+	Param<double> flushInterval{this, "flushInterval", "Flush baskets and save tree headers every n seconds, 0 to disable (use autoSave for size-based saving)", 0};
+
 	Output<TTree> output{this, "", "Output Tree"};
 
 	void newReduction() override;
@@ -106,6 +288,7 @@ public:
 	void finalizeReduction() override;
 
 	using ReducerBric::ReducerBric;
+	~RootTreeWriter();
 };
 
 
@@ -116,6 +299,11 @@ protected:
 
 	std::unique_ptr<TFile> m_inputFile;
 
+	// Open output file of an upstream RootFileWriter, not owned by us
+	TFile* m_sharedInputFile = nullptr;
+
+	TFile* inputFile() { return (m_sharedInputFile != nullptr) ? m_sharedInputFile : m_inputFile.get(); }
+
 public:
 	class ContentGroup final: public DynOutputGroup {
 	protected:
@@ -123,10 +311,18 @@ public:
 
 		TDirectory* m_inputDir = nullptr;
 
+		// With reuseUnchanged: keys in m_inputDir by name, and key identity
+		// of each output value read for reuse (such values are owned by us)
+		std::unordered_map<std::string, TKey*> m_keyIndex;
+		std::map<const OutputTerminal*, std::string> m_outputKeys;
+
 		InputTerminal* connectInputToInner(Bric &bric, PropKey inputName, PropPath::Fragment sourcePath) override;
 
 		ContentGroup& subGroup(PropKey name);
 
+		void indexKeys();
+
+		void releaseOutputValue(OutputTerminal &output);
 		void releaseOutputValues();
 
 	public:
@@ -144,6 +340,8 @@ public:
 
 	Input<std::string> input{this, "", "File Name"};
 
+	Param<bool> reuseUnchanged{this, "reuseUnchanged", "Keep objects read from a previous file and don't read them again if their key is unchanged", false};
+
 	ContentGroup content{this, this, "content"};
 
 	void processInput() override;
@@ -157,12 +355,57 @@ class RootFileWriter: public AsyncReducerBric {
 protected:
 	static const PropKey s_thisDirName;
 
-	static void writeObject(TNamed *obj);
+	static void writeObject(TNamed *obj, bool replacePrevious = false);
 
 	bool m_outputReadyForWrite = false;
 
+	// Tree writers with trees in our output, locked while flushing
+	std::vector<RootTreeWriter*> m_treeWriters;
+
+	// Periodic flush, checked on each input and before each tree entry:
+	std::chrono::steady_clock::time_point m_lastFlush;
+	int64_t m_inputsSinceFlush = 0;
+
+	// Rollover: index of the current output file and tree entries (of all
+	// tree writers) written to it
+	size_t m_fileIndex = 0;
+	int64_t m_entriesInFile = 0;
+	std::vector<std::string> m_outputFileNames;
+
+	// Held while the output file is written to or replaced, by our own
+	// processing and by the fill threads of tree writers
+	std::mutex m_outputMutex;
+
+	// TBufferMerger and its in-memory files, if bufferMerger is enabled
+	struct MergedOutput;
+	std::shared_ptr<MergedOutput> m_mergedOutput;
+
+	// Asynchronous disk copy of in-memory output
+	std::future<void> m_diskCopy;
+
+	virtual void waitForDiskCopy();
+
 	void connectInputs() override;
 
+	virtual TDirectory* newMergedOutputFile();
+
+	bool periodicFlush() { return (flushInterval > 0) || (flushInputs > 0); }
+
+	virtual bool flushDue();
+	virtual void flushOutput();
+
+	bool rolloverEnabled() { return (maxFileSize > 0) || (maxFileEntries > 0); }
+
+	virtual std::string currentFileName();
+
+	virtual bool rolloverDue();
+	virtual void rolloverOutput();
+
+	// Called by tree writers before each fill. The tree writers are reducers
+	// and send no input to us before they're finished, so output file
+	// maintenance during the run has to be driven from here.
+	virtual void beforeTreeFill();
+
 public:
 	class ContentGroup final: public DynInputGroup {
 	protected:
@@ -184,6 +427,8 @@ public:
 
 		ContentGroup& subGroup(PropKey name);
 
+		TDirectory* newMergedOutputDir();
+
 	public:
 		void processInput() override;
 
@@ -192,7 +437,7 @@ public:
 		void addContent(const PropVal &content);
 		void addContent(const PropPath &sourcePath);
 
-		void newOutput();
+		void newOutput(TDirectory *outputFile);
 
 		ContentGroup() {}
 		ContentGroup(RootFileWriter *writer, Bric *parentBric, PropKey groupName);
@@ -203,9 +448,19 @@ public:
 	Param<std::string> fileName{this, "fileName", "File Name"};
 	Param<std::string> title{this, "title", "Title"};
 	Param<PropVal> content{this, "content", "Content"};
+	Param<int32_t> compression{this, "compression", "File compression settings (100 * algorithm + level, -1 for ROOT default)", -1};
+	Param<bool> bufferMerger{this, "bufferMerger", "Write via TBufferMerger, trees are filled in separate in-memory files and merged in the background", false};
+	Param<bool> shareOutput{this, "shareOutput", "Pass the open output TFile to connected RootFileReaders, instead of them reopening it", false};
+	Param<bool> inMemory{this, "inMemory", "Write into a TMemFile, copied to disk asynchronously after finalization (implies shareOutput, TTrees can't be read back by RootTreeReader)", false};
+	Param<double> flushInterval{this, "flushInterval", "Write file contents every n seconds, keeping only the latest snapshot of each object in memory, 0 to disable (not supported with bufferMerger or inMemory)", 0};
+	Param<int64_t> flushInputs{this, "flushInputs", "Write file contents every n inputs or tree entries, like flushInterval, 0 to disable", 0};
+	Param<int64_t> maxFileSize{this, "maxFileSize", "Roll over to the next output file after n bytes have been written (checked before each tree entry), 0 to disable", 0};
+	Param<int64_t> maxFileEntries{this, "maxFileEntries", "Roll over to the next output file after n tree entries (counted over all tree writers), 0 to disable", 0};
+	Param<std::string> rolloverFileName{this, "rolloverFileName", "Output file name pattern for rollover, \"{n}\" is replaced by the file index (default: fileName with \"_{n}\" before the extension)", ""};
 
 	Output<std::string> output{this, "output", "Output File Name"};
 	Output<TFile> outputFile{this, "outputFile", "Output TFile"};
+	Output<std::vector<std::string>> outputFileNames{this, "outputFileNames", "Names of all output files (more than one on rollover)"};
 
 	void newReduction() override;
 
@@ -217,6 +472,9 @@ public:
 	virtual void openOutputForWrite();
 	virtual void finalizeOutput();
 
+	// Finalized output file for downstream readers, nullptr if not shared
+	virtual TFile* sharedOutputFile();
+
 	~RootFileWriter() override;
 
 	using AsyncReducerBric::AsyncReducerBric;
@@ -17,6 +17,20 @@
 
 #include "textbrics.h"
 
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <unordered_map>
+
+#include <TBase64.h>
+
+#include "external/rapidjson/reader.h"
+
+#include "TypeReflection.h"
+
 
 using namespace std;
 
@@ -26,16 +40,50 @@ namespace dbrx {
 
 void TextFileReader::processInput() {
 	dbrx_log_trace("TextFileReader \"%s\", opening next input \"%s\""_format(absolutePath(), input.get()));
+	m_mappedFile.close();
 	try {
-		m_inputStream.open(input);
+		if (memoryMap && MappedFile::isMappable(input)) {
+			m_mappedFile.open(input);
+			m_mappedFile.advise(MappedFile::Advice::Sequential);
+			m_mappedPos = 0;
+			m_releasedPos = 0;
+		} else {
+			m_inputStream.open(input);
+		}
 	} catch (std::runtime_error &e) {
 		throw runtime_error("Can't open \"%s\" for input in bric \"%s\": %s"_format(input.get(), absolutePath(), e.what()));
 	}
 }
 
 
+bool TextFileReader::nextMappedLine() {
+	const char *data = m_mappedFile.data();
+	size_t size = m_mappedFile.size();
+	if (m_mappedPos >= size) return false;
+
+	const char *begin = data + m_mappedPos;
+	const char *newline = static_cast<const char*>(memchr(begin, '\n', size - m_mappedPos));
+	const char *end = (newline != nullptr) ? newline : data + size;
+	// Reuses the capacity of the output string, no allocation for most lines:
+	output.get().assign(begin, end);
+	m_mappedPos = (newline != nullptr) ? size_t(newline - data) + 1 : size;
+
+	// Drop pages already read, to keep resident memory flat for large files:
+	const size_t releaseChunk = 16 * 1024 * 1024;
+	if (m_mappedPos - m_releasedPos >= 2 * releaseChunk) {
+		m_mappedFile.advise(MappedFile::Advice::DontNeed, m_releasedPos, releaseChunk);
+		m_releasedPos += releaseChunk;
+	}
+	return true;
+}
+
+
 bool TextFileReader::nextOutput() {
-	if (getline(m_inputStream.stream(), output.get())) {
+	if (m_mappedFile.isOpen()) {
+		if (nextMappedLine()) return true;
+		m_mappedFile.close();
+		return false;
+	} else if (getline(m_inputStream.stream(), output.get())) {
 		return true;
 	} else {
 		m_inputStream.close();
@@ -44,4 +92,597 @@ bool TextFileReader::nextOutput() {
 }
 
 
+
+namespace {
+
+const char* trimFront(const char* begin, const char* end) {
+	while ((begin < end) && ((*begin == ' ') || (*begin == '\t'))) ++begin;
+	return begin;
+}
+
+const char* trimBack(const char* begin, const char* end) {
+	while ((end > begin) && ((end[-1] == ' ') || (end[-1] == '\t'))) --end;
+	return end;
+}
+
+
+template<typename T> bool parseInteger(const char* begin, const char* end, T &x) {
+	using U = typename make_unsigned<T>::type;
+	begin = trimFront(begin, end); end = trimBack(begin, end);
+
+	bool negative = false;
+	if ((begin < end) && ((*begin == '-') || (*begin == '+'))) {
+		negative = (*begin == '-');
+		if (negative && !numeric_limits<T>::is_signed) return false;
+		++begin;
+	}
+	if (begin == end) return false;
+
+	const U limit = negative ? U(numeric_limits<T>::max()) + 1 : U(numeric_limits<T>::max());
+	U result = 0;
+	for (const char *p = begin; p < end; ++p) {
+		unsigned digit = unsigned(*p) - unsigned('0');
+		if (digit > 9) return false;
+		if (result > (limit - digit) / 10) return false;
+		result = result * 10 + digit;
+	}
+	x = negative ? T(-(result - 1) - 1) : T(result);
+	return true;
+}
+
+
+bool parseDouble(const char* begin, const char* end, double &x, std::string &tmp) {
+	begin = trimFront(begin, end); end = trimBack(begin, end);
+	if (begin == end) { x = numeric_limits<double>::quiet_NaN(); return true; }
+
+	// Fast path for plain decimal numbers with at most 19 significant digits
+	// and small exponents, exact as both mantissa and power of ten are exact
+	// doubles (see Clinger, "How to read floating point numbers accurately"):
+	static const double powersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char *p = begin;
+	bool negative = false;
+	if ((*p == '-') || (*p == '+')) { negative = (*p == '-'); ++p; }
+
+	uint64_t mantissa = 0;
+	int nSignificant = 0, nDigits = 0, exponent = 0;
+	bool fastPath = true;
+	for (; (p < end) && (unsigned(*p) - unsigned('0') <= 9); ++p, ++nDigits) {
+		if ((mantissa > 0) || (*p != '0')) ++nSignificant;
+		mantissa = mantissa * 10 + unsigned(*p - '0');
+	}
+	if ((p < end) && (*p == '.')) {
+		for (++p; (p < end) && (unsigned(*p) - unsigned('0') <= 9); ++p, ++nDigits) {
+			if ((mantissa > 0) || (*p != '0')) ++nSignificant;
+			mantissa = mantissa * 10 + unsigned(*p - '0');
+			--exponent;
+		}
+	}
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		++p;
+		bool negExp = false;
+		if ((p < end) && ((*p == '-') || (*p == '+'))) { negExp = (*p == '-'); ++p; }
+		int e = 0;
+		const char *expStart = p;
+		for (; (p < end) && (unsigned(*p) - unsigned('0') <= 9); ++p) if (e < 10000) e = e * 10 + (*p - '0');
+		if (p == expStart) fastPath = false;
+		exponent += negExp ? -e : e;
+	}
+
+	if ((nDigits == 0) || (p != end) || (nSignificant > 19)) fastPath = false;
+	if (fastPath && (mantissa <= (uint64_t(1) << 53)) && (exponent >= -22) && (exponent <= 22)) {
+		double m = double(mantissa);
+		x = (exponent < 0) ? m / powersOf10[-exponent] : m * powersOf10[exponent];
+		if (negative) x = -x;
+		return true;
+	}
+
+	// Everything else (long mantissas, large exponents, nan, inf) via strtod:
+	tmp.assign(begin, end);
+	char *parsedEnd = nullptr;
+	x = strtod(tmp.c_str(), &parsedEnd);
+	return parsedEnd == tmp.c_str() + tmp.size();
+}
+
+
+template<typename T> struct FieldParser {
+	static void parse(const char* begin, const char* end, T &x, std::string &tmp) {
+		if (!parseInteger(begin, end, x)) throw invalid_argument("Invalid integer value \"%s\""_format(string(begin, end)));
+	}
+};
+
+template<> struct FieldParser<double> {
+	static void parse(const char* begin, const char* end, double &x, std::string &tmp) {
+		if (!parseDouble(begin, end, x, tmp)) throw invalid_argument("Invalid floating point value \"%s\""_format(string(begin, end)));
+	}
+};
+
+template<> struct FieldParser<float> {
+	static void parse(const char* begin, const char* end, float &x, std::string &tmp) {
+		double d = 0;
+		FieldParser<double>::parse(begin, end, d, tmp);
+		x = float(d);
+	}
+};
+
+template<> struct FieldParser<std::string> {
+	static void parse(const char* begin, const char* end, std::string &x, std::string &tmp) {
+		x.assign(begin, end);
+	}
+};
+
+} // namespace
+
+
+
+template<typename T> class CsvReader::Columns::TypedColumn final: public Column {
+protected:
+	std::string m_tmp;
+
+public:
+	void setField(const char* begin, const char* end) override {
+		FieldParser<T>::parse(begin, end, *m_terminal.value().typedPtr<T>(), m_tmp);
+	}
+
+	TypedColumn(OutputTerminal& terminal, size_t fieldIndex): Column(terminal, fieldIndex) {
+		if (m_terminal.value().empty()) m_terminal.value().setToDefault();
+	}
+};
+
+
+template<typename T> class CsvReader::Columns::BatchColumn final: public Column {
+protected:
+	std::string m_tmp;
+
+public:
+	void clearBatch() override {
+		m_terminal.value().typedPtr< std::vector<T> >()->clear();
+	}
+
+	void setField(const char* begin, const char* end) override {
+		std::vector<T> &column = *m_terminal.value().typedPtr< std::vector<T> >();
+		column.emplace_back();
+		FieldParser<T>::parse(begin, end, column.back(), m_tmp);
+	}
+
+	BatchColumn(OutputTerminal& terminal, size_t fieldIndex): Column(terminal, fieldIndex) {
+		if (m_terminal.value().empty()) m_terminal.value().setToDefault();
+	}
+};
+
+
+std::unique_ptr<CsvReader::Columns::Column> CsvReader::Columns::newColumn(OutputTerminal& terminal, size_t fieldIndex, bool batched) {
+	const std::type_info &type = terminal.value().typeInfo();
+	if (!batched) {
+		if (type == typeid(int32_t)) return unique_ptr<Column>(new TypedColumn<int32_t>(terminal, fieldIndex));
+		else if (type == typeid(int64_t)) return unique_ptr<Column>(new TypedColumn<int64_t>(terminal, fieldIndex));
+		else if (type == typeid(uint32_t)) return unique_ptr<Column>(new TypedColumn<uint32_t>(terminal, fieldIndex));
+		else if (type == typeid(uint64_t)) return unique_ptr<Column>(new TypedColumn<uint64_t>(terminal, fieldIndex));
+		else if (type == typeid(float)) return unique_ptr<Column>(new TypedColumn<float>(terminal, fieldIndex));
+		else if (type == typeid(double)) return unique_ptr<Column>(new TypedColumn<double>(terminal, fieldIndex));
+		else if (type == typeid(std::string)) return unique_ptr<Column>(new TypedColumn<std::string>(terminal, fieldIndex));
+		else throw invalid_argument("Output \"%s\" has unsupported type %s, must be int32_t, int64_t, uint32_t, uint64_t, float, double or std::string"_format(terminal.absolutePath(), TypeReflection(type).name()));
+	} else {
+		if (type == typeid(std::vector<int32_t>)) return unique_ptr<Column>(new BatchColumn<int32_t>(terminal, fieldIndex));
+		else if (type == typeid(std::vector<int64_t>)) return unique_ptr<Column>(new BatchColumn<int64_t>(terminal, fieldIndex));
+		else if (type == typeid(std::vector<uint32_t>)) return unique_ptr<Column>(new BatchColumn<uint32_t>(terminal, fieldIndex));
+		else if (type == typeid(std::vector<uint64_t>)) return unique_ptr<Column>(new BatchColumn<uint64_t>(terminal, fieldIndex));
+		else if (type == typeid(std::vector<float>)) return unique_ptr<Column>(new BatchColumn<float>(terminal, fieldIndex));
+		else if (type == typeid(std::vector<double>)) return unique_ptr<Column>(new BatchColumn<double>(terminal, fieldIndex));
+		else if (type == typeid(std::vector<std::string>)) return unique_ptr<Column>(new BatchColumn<std::string>(terminal, fieldIndex));
+		else throw invalid_argument("Output \"%s\" has unsupported type %s for batched reading, must be std::vector of int32_t, int64_t, uint32_t, uint64_t, float, double or std::string"_format(terminal.absolutePath(), TypeReflection(type).name()));
+	}
+}
+
+
+void CsvReader::Columns::connectColumns(const std::vector<std::string> &fieldNames, bool batched) {
+	m_columns.clear();
+	for (auto &elem: m_outputs) {
+		OutputTerminal *terminal = elem.second;
+		string columnName = terminal->name().toString();
+		size_t fieldIndex = 0;
+		if (!fieldNames.empty()) {
+			auto found = find(fieldNames.begin(), fieldNames.end(), columnName);
+			if (found == fieldNames.end()) throw runtime_error("Column \"%s\" not found in input of \"%s\""_format(columnName, absolutePath()));
+			fieldIndex = size_t(found - fieldNames.begin());
+		} else {
+			if (!terminal->name().isInteger()) throw invalid_argument("No column names available, output \"%s\" must be named by column number"_format(terminal->absolutePath()));
+			fieldIndex = size_t(terminal->name().asInteger());
+		}
+		dbrx_log_debug("Connecting CSV column %s as \"%s\" in \"%s\"", fieldIndex, columnName, absolutePath());
+		m_columns.push_back(newColumn(*terminal, fieldIndex, batched));
+	}
+}
+
+
+void CsvReader::Columns::clearBatch() {
+	for (auto &column: m_columns) column->clearBatch();
+}
+
+
+void CsvReader::Columns::setFields(const std::vector<const char*> &fieldBegin, const std::vector<const char*> &fieldEnd, int64_t lineNo) {
+	for (auto &column: m_columns) {
+		size_t i = column->fieldIndex();
+		if (i >= fieldBegin.size()) throw runtime_error("Line %s has only %s fields, missing column of output \"%s\""_format(lineNo, fieldBegin.size(), column->terminal().absolutePath()));
+		try {
+			column->setField(fieldBegin[i], fieldEnd[i]);
+		} catch (const std::invalid_argument &e) {
+			throw runtime_error("%s in line %s, column of output \"%s\""_format(e.what(), lineNo, column->terminal().absolutePath()));
+		}
+	}
+}
+
+
+bool CsvReader::nextLine(const char* &begin, const char* &end) {
+	while (true) {
+		char *data = m_buffer.data();
+		const char *newline = static_cast<const char*>(memchr(data + m_bufferPos, '\n', m_bufferEnd - m_bufferPos));
+		if ((newline != nullptr) || (m_inputEnd && (m_bufferPos < m_bufferEnd))) {
+			begin = data + m_bufferPos;
+			end = (newline != nullptr) ? newline : data + m_bufferEnd;
+			m_bufferPos = (newline != nullptr) ? size_t(newline - data) + 1 : m_bufferEnd;
+			if ((end > begin) && (end[-1] == '\r')) --end;
+			++m_lineNo;
+			return true;
+		}
+		if (m_inputEnd) return false;
+
+		// Move incomplete line to front, grow buffer if it doesn't fit:
+		size_t remaining = m_bufferEnd - m_bufferPos;
+		if (m_bufferPos > 0) memmove(data, data + m_bufferPos, remaining);
+		m_bufferPos = 0;
+		m_bufferEnd = remaining;
+		if (m_bufferEnd == m_buffer.size()) m_buffer.resize(2 * m_buffer.size());
+
+		istream &in = m_inputStream.stream();
+		in.read(m_buffer.data() + m_bufferEnd, m_buffer.size() - m_bufferEnd);
+		m_bufferEnd += size_t(in.gcount());
+		if (!in) {
+			if (in.bad()) throw runtime_error("Error reading \"%s\" in bric \"%s\""_format(input.get(), absolutePath()));
+			m_inputEnd = true;
+		}
+	}
+}
+
+
+void CsvReader::splitLine(const char* begin, const char* end) {
+	const char delim = (delimiter.get() == "\\t") ? '\t' : delimiter->at(0);
+
+	m_fieldBegin.clear();
+	m_fieldEnd.clear();
+	const char *pos = begin;
+	while (true) {
+		if ((pos < end) && (*pos == '"')) {
+			// Quoted field (may contain delimiters and doubled quotes), unquoted
+			// into separate storage. Pointers to it are set after the loop, as
+			// growing m_unquoted moves the strings:
+			size_t i = m_fieldBegin.size();
+			if (m_unquoted.size() <= i) m_unquoted.resize(i + 1);
+			string &field = m_unquoted[i];
+			field.clear();
+			const char *p = pos + 1;
+			while (true) {
+				const char *quote = static_cast<const char*>(memchr(p, '"', size_t(end - p)));
+				if (quote == nullptr) throw runtime_error("Unterminated quoted field in line %s of \"%s\""_format(m_lineNo, input.get()));
+				field.append(p, quote);
+				if ((quote + 1 < end) && (quote[1] == '"')) { field.push_back('"'); p = quote + 2; }
+				else { p = quote + 1; break; }
+			}
+			m_fieldBegin.push_back(nullptr);
+			m_fieldEnd.push_back(nullptr);
+			pos = static_cast<const char*>(memchr(p, delim, size_t(end - p)));
+		} else {
+			const char *next = static_cast<const char*>(memchr(pos, delim, size_t(end - pos)));
+			m_fieldBegin.push_back(pos);
+			m_fieldEnd.push_back((next != nullptr) ? next : end);
+			pos = next;
+		}
+		if (pos == nullptr) break;
+		++pos;
+	}
+
+	for (size_t i = 0; i < m_fieldBegin.size(); ++i) {
+		if (m_fieldBegin[i] == nullptr) {
+			const string &field = m_unquoted[i];
+			m_fieldBegin[i] = field.data();
+			m_fieldEnd[i] = field.data() + field.size();
+		}
+	}
+}
+
+
+bool CsvReader::readRow() {
+	const char *begin = nullptr, *end = nullptr;
+	do {
+		if (!nextLine(begin, end)) return false;
+	} while (begin == end);
+
+	splitLine(begin, end);
+	columns.setFields(m_fieldBegin, m_fieldEnd, m_lineNo);
+	return true;
+}
+
+
+void CsvReader::processInput() {
+	dbrx_log_trace("CsvReader \"%s\", opening next input \"%s\""_format(absolutePath(), input.get()));
+	if ((delimiter->size() != 1) && (delimiter.get() != "\\t"))
+		throw invalid_argument("Delimiter must be a single character in bric \"%s\""_format(absolutePath()));
+	if (bufferSize <= 0) throw invalid_argument("Buffer size must be positive in bric \"%s\""_format(absolutePath()));
+
+	try {
+		m_inputStream.open(input);
+	} catch (std::runtime_error &e) {
+		throw runtime_error("Can't open \"%s\" for input in bric \"%s\": %s"_format(input.get(), absolutePath(), e.what()));
+	}
+
+	m_buffer.resize(size_t(bufferSize.get()));
+	m_bufferPos = 0;
+	m_bufferEnd = 0;
+	m_inputEnd = false;
+	m_lineNo = 0;
+
+	vector<string> fieldNames = columnNames;
+	if (header) {
+		const char *begin = nullptr, *end = nullptr;
+		if (nextLine(begin, end)) {
+			splitLine(begin, end);
+			if (fieldNames.empty()) {
+				for (size_t i = 0; i < m_fieldBegin.size(); ++i)
+					fieldNames.push_back(string(trimFront(m_fieldBegin[i], m_fieldEnd[i]), trimBack(m_fieldBegin[i], m_fieldEnd[i])));
+			}
+		}
+	}
+
+	columns.connectColumns(fieldNames, batchSize > 0);
+
+	index = -1;
+	batchEntries = 0;
+}
+
+
+bool CsvReader::nextOutput() {
+	bool hasOutput = false;
+	index += batchEntries.get();
+	if (batchSize > 0) {
+		columns.clearBatch();
+		ssize_t n = 0;
+		while ((n < batchSize) && readRow()) ++n;
+		if (index.get() < 0) index = 0;
+		batchEntries = n;
+		hasOutput = (n > 0);
+	} else {
+		hasOutput = readRow();
+		if (index.get() < 0) index = 0;
+		batchEntries = 1;
+	}
+
+	if (!hasOutput) m_inputStream.close();
+	return hasOutput;
+}
+
+
+// Applies the SAX events of the JSON reader to the previous output value,
+// so strings, arrays and props entries are reused as long as the structure
+// of the lines doesn't change:
+
+class JsonLinesReader::LineParser {
+public:
+	using Encoding = rapidjson::UTF8<>;
+	using Ch = Encoding::Ch;
+	using SizeType = rapidjson::SizeType;
+
+protected:
+	struct Level {
+		PropVal *value;
+		PropVal *member;
+		size_t index;
+		size_t keysBegin;
+		bool expectKey;
+	};
+
+	rapidjson::GenericReader<Encoding> m_reader;
+
+	PropVal *m_root = nullptr;
+	std::vector<Level> m_levels;
+	std::vector<PropKey> m_keys;
+
+	// Avoids re-resolving (and number-checking) the same keys on every line
+	std::unordered_map<std::string, PropKey> m_keyCache;
+	std::string m_keyTmp;
+
+	PropVal& nextValue() {
+		if (m_levels.empty()) return *m_root;
+		Level &level = m_levels.back();
+		if (level.value->isProps()) return *level.member;
+		PropVal::Array &arr = level.value->asArray();
+		size_t i = level.index++;
+		if (i >= arr.size()) arr.emplace_back();
+		return arr[i];
+	}
+
+	void valueDone() {
+		if (!m_levels.empty() && m_levels.back().value->isProps()) m_levels.back().expectKey = true;
+	}
+
+	const PropKey& resolveKey(const Ch* str, SizeType length) {
+		m_keyTmp.assign(str, length);
+		auto found = m_keyCache.find(m_keyTmp);
+		if (found != m_keyCache.end()) return found->second;
+		if (m_keyCache.size() >= 100000) m_keyCache.clear();
+		return m_keyCache.emplace(m_keyTmp, PropKey(m_keyTmp)).first->second;
+	}
+
+	void setString(PropVal &value, const Ch* str, SizeType length) {
+		if ((length >= 6) && (strncmp(str, "data:,", 6) == 0)) {
+			// In-situ strings are null-terminated
+			TString decoded = TBase64::Decode(str + 6);
+			const uint8_t *decodedData = reinterpret_cast<const uint8_t*>(decoded.Data());
+			value = PropVal::Bytes(decodedData, decodedData + decoded.Length());
+		} else {
+			value.setString(str, length);
+		}
+	}
+
+	template<typename T> void setValue(T x) {
+		nextValue() = x;
+		valueDone();
+	}
+
+public:
+	void Null_() { setValue(PropVal()); }
+
+	void Bool_(bool b) { setValue(b); }
+
+	void Int(int i) { setValue(int64_t(i)); }
+	void Uint(unsigned i) { setValue(int64_t(i)); }
+	void Int64(int64_t i) { setValue(i); }
+	void Uint64(uint64_t i) { setValue(int64_t(i)); }
+
+	void Double(double d) { setValue(d); }
+
+	void String(const Ch* str, SizeType length, bool copy) {
+		if (!m_levels.empty() && m_levels.back().expectKey) {
+			Level &level = m_levels.back();
+			const PropKey &key = resolveKey(str, length);
+			m_keys.push_back(key);
+			level.member = &level.value->asProps()[key];
+			level.expectKey = false;
+		} else {
+			setString(nextValue(), str, length);
+			valueDone();
+		}
+	}
+
+	void StartObject() {
+		PropVal &value = nextValue();
+		if (!value.isProps()) value = PropVal::props();
+		m_levels.push_back({&value, nullptr, 0, m_keys.size(), true});
+	}
+
+	void EndObject(SizeType memberCount) {
+		Level &level = m_levels.back();
+		PropVal::Props &props = level.value->asProps();
+		if (props.size() != memberCount) {
+			// Remove members of the previous value that are missing now:
+			auto keysBegin = m_keys.begin() + level.keysBegin;
+			for (auto p = props.begin(); p != props.end();) {
+				if (find(keysBegin, m_keys.end(), p->first) == m_keys.end()) p = props.erase(p);
+				else ++p;
+			}
+		}
+		m_keys.resize(level.keysBegin);
+		m_levels.pop_back();
+		valueDone();
+	}
+
+	void StartArray() {
+		PropVal &value = nextValue();
+		if (!value.isArray()) value = PropVal::array();
+		m_levels.push_back({&value, nullptr, 0, m_keys.size(), false});
+	}
+
+	void EndArray(SizeType elementCount) {
+		m_levels.back().value->asArray().resize(elementCount);
+		m_levels.pop_back();
+		valueDone();
+	}
+
+	// Parses a null-terminated line in place, the line content is destroyed
+	void parse(char* line, PropVal &target) {
+		m_root = &target;
+		m_levels.clear();
+		m_keys.clear();
+		rapidjson::GenericInsituStringStream<Encoding> in(line);
+		if (! m_reader.Parse<rapidjson::kParseInsituFlag, rapidjson::GenericInsituStringStream<Encoding>, LineParser>(in, *this))
+			throw invalid_argument("JSON parse error at offset %s: %s"_format(m_reader.GetErrorOffset(), m_reader.GetParseError()));
+	}
+};
+
+
+JsonLinesReader::~JsonLinesReader() {}
+
+
+char* JsonLinesReader::nextLine() {
+	if (m_mappedFile.isOpen()) {
+		char *data = m_mappedFile.data();
+		size_t size = m_mappedFile.size();
+		if (m_mappedPos >= size) return nullptr;
+
+		char *begin = data + m_mappedPos;
+		char *newline = static_cast<char*>(memchr(begin, '\n', size - m_mappedPos));
+
+		// Drop pages already parsed, to keep resident memory flat for large files:
+		const size_t releaseChunk = 16 * 1024 * 1024;
+		if (m_mappedPos - m_releasedPos >= 2 * releaseChunk) {
+			m_mappedFile.advise(MappedFile::Advice::DontNeed, m_releasedPos, releaseChunk);
+			m_releasedPos += releaseChunk;
+		}
+
+		if (newline != nullptr) {
+			// Private mapping, terminating the line in place doesn't touch the file
+			*newline = '\0';
+			m_mappedPos = size_t(newline - data) + 1;
+			return begin;
+		} else {
+			// Last line without newline, no room for a terminator in the mapping
+			m_lineBuffer.assign(begin, data + size);
+			m_mappedPos = size;
+			return &m_lineBuffer[0];
+		}
+	} else {
+		if (!getline(m_inputStream.stream(), m_lineBuffer)) return nullptr;
+		return &m_lineBuffer[0];
+	}
+}
+
+
+void JsonLinesReader::processInput() {
+	dbrx_log_trace("JsonLinesReader \"%s\", opening next input \"%s\""_format(absolutePath(), input.get()));
+	if (!m_parser) m_parser = unique_ptr<LineParser>(new LineParser);
+
+	m_mappedFile.close();
+	try {
+		if (memoryMap && MappedFile::isMappable(input)) {
+			m_mappedFile.open(input);
+			m_mappedFile.advise(MappedFile::Advice::Sequential);
+			m_mappedPos = 0;
+			m_releasedPos = 0;
+		} else {
+			m_inputStream.open(input);
+		}
+	} catch (std::runtime_error &e) {
+		throw runtime_error("Can't open \"%s\" for input in bric \"%s\": %s"_format(input.get(), absolutePath(), e.what()));
+	}
+
+	m_lineNo = 0;
+	index = -1;
+}
+
+
+bool JsonLinesReader::nextOutput() {
+	while (char *line = nextLine()) {
+		++m_lineNo;
+		// Skip empty lines:
+		const char *p = line;
+		while ((*p == ' ') || (*p == '\t') || (*p == '\r')) ++p;
+		if (*p == '\0') continue;
+
+		try {
+			m_parser->parse(line, output.get());
+		} catch (std::exception &e) {
+			throw runtime_error("Invalid JSON in line %s of \"%s\" in bric \"%s\": %s"_format(m_lineNo, input.get(), absolutePath(), e.what()));
+		}
+		index += 1;
+		return true;
+	}
+
+	if (m_mappedFile.isOpen()) m_mappedFile.close();
+	else m_inputStream.close();
+	return false;
+}
+
+
 } // namespace dbrx
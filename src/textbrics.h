@@ -19,9 +19,14 @@
 #define DBRX_TEXTBRICS_H
 
 #include <iostream>
+#include <vector>
+#include <memory>
 
 #include "Bric.h"
 #include "ManagedStream.h"
+#include "MappedFile.h"
+#include "BlockOutputBuffer.h"
+#include "NumberFormat.h"
 
 
 namespace dbrx {
@@ -31,9 +36,17 @@ class TextFileReader: public MapperBric {
 protected:
 	ManagedInputStream m_inputStream;
 
+	MappedFile m_mappedFile;
+	size_t m_mappedPos = 0;
+	size_t m_releasedPos = 0;
+
+	virtual bool nextMappedLine();
+
 public:
 	Input<std::string> input{this, "", "Input filename"};
 
+	Param<bool> memoryMap{this, "memoryMap", "Map regular input files into memory and split lines with memchr (stdin and pipes are read via stream)", false};
+
 	Output<std::string> output{this, "", "Output line"};
 
 	void processInput();
@@ -45,14 +58,146 @@ public:
 
 
 
+class CsvReader: public MapperBric {
+protected:
+	ManagedInputStream m_inputStream;
+
+	// Input is read in large blocks, lines are split in place
+	std::vector<char> m_buffer;
+	size_t m_bufferPos = 0;
+	size_t m_bufferEnd = 0;
+	bool m_inputEnd = false;
+	int64_t m_lineNo = 0;
+
+	std::vector<const char*> m_fieldBegin;
+	std::vector<const char*> m_fieldEnd;
+	std::vector<std::string> m_unquoted;
+
+	virtual bool nextLine(const char* &begin, const char* &end);
+	virtual void splitLine(const char* begin, const char* end);
+
+	virtual bool readRow();
+
+public:
+	class Columns final: public DynOutputGroup {
+	protected:
+		// Parses one field of each row into an output terminal
+		class Column {
+		protected:
+			OutputTerminal& m_terminal;
+			size_t m_fieldIndex;
+
+		public:
+			size_t fieldIndex() const { return m_fieldIndex; }
+			const OutputTerminal& terminal() const { return m_terminal; }
+
+			virtual void clearBatch() {}
+			virtual void setField(const char* begin, const char* end) = 0;
+
+			Column(OutputTerminal& terminal, size_t fieldIndex)
+				: m_terminal(terminal), m_fieldIndex(fieldIndex) {}
+			virtual ~Column() {}
+		};
+
+		template<typename T> class TypedColumn;
+		template<typename T> class BatchColumn;
+
+		std::vector< std::unique_ptr<Column> > m_columns;
+
+		static std::unique_ptr<Column> newColumn(OutputTerminal& terminal, size_t fieldIndex, bool batched);
+
+	public:
+		void connectColumns(const std::vector<std::string> &fieldNames, bool batched);
+
+		void clearBatch();
+		void setFields(const std::vector<const char*> &fieldBegin, const std::vector<const char*> &fieldEnd, int64_t lineNo);
+
+		using DynOutputGroup::DynOutputGroup;
+	};
+
+	Input<std::string> input{this, "", "Input filename"};
+
+	Param<std::string> delimiter{this, "delimiter", "Field delimiter (single character, \"\\t\" for TSV)", ","};
+	Param<bool> header{this, "header", "First line contains the column names", true};
+	Param<std::vector<std::string>> columnNames{this, "columnNames", "Column names, override header (columns are named by number if neither is available)"};
+	Param<int64_t> batchSize{this, "batchSize", "Emit columns of up to n rows as std::vector outputs (0 for one row per output)", 0};
+	Param<int64_t> bufferSize{this, "bufferSize", "Input block size in bytes", 1024 * 1024};
+
+	Columns columns{this, "columns"};
+
+	Output<ssize_t> index{this, "index", "Index of current row (first row of batch)"};
+	Output<ssize_t> batchEntries{this, "batchEntries", "Number of rows in current batch"};
+
+	void processInput() override;
+
+	bool nextOutput() override;
+
+	using MapperBric::MapperBric;
+};
+
+
+
+class JsonLinesReader: public MapperBric {
+protected:
+	// Holds the JSON reader and the PropVal updater, defined in textbrics.cxx
+	class LineParser;
+
+	std::unique_ptr<LineParser> m_parser;
+
+	ManagedInputStream m_inputStream;
+	std::string m_lineBuffer;
+
+	MappedFile m_mappedFile;
+	size_t m_mappedPos = 0;
+	size_t m_releasedPos = 0;
+
+	int64_t m_lineNo = 0;
+
+	// Returns a null-terminated, writable line (newline replaced in place)
+	virtual char* nextLine();
+
+public:
+	Input<std::string> input{this, "", "Input filename"};
+
+	Param<bool> memoryMap{this, "memoryMap", "Map regular input files into memory and parse lines in place (stdin and pipes are read via stream)", true};
+
+	Output<PropVal> output{this, "", "Output value (storage is reused between lines with the same structure)"};
+	Output<ssize_t> index{this, "index", "Index of current output"};
+
+	void processInput() override;
+
+	bool nextOutput() override;
+
+	using MapperBric::MapperBric;
+	~JsonLinesReader();
+};
+
+
+
 template<typename T> class TextFilePrinter: public ReducerBric {
 protected:
 	ManagedOutputStream m_outputStream;
+	BlockOutputBuffer m_outputBuffer;
+
+	// Numbers are written via NumberFormat (shortest round-trip reals),
+	// everything else via the formatter stream:
+	template<typename U> void printValue(const U &x) { m_outputBuffer.formatter() << x; }
+	void printValue(double x) { NumberFormat::appendReal(m_outputBuffer.block(), x); }
+	void printValue(float x) { NumberFormat::appendReal(m_outputBuffer.block(), x); }
+	void printValue(int32_t x) { NumberFormat::appendInteger(m_outputBuffer.block(), int64_t(x)); }
+	void printValue(uint32_t x) { NumberFormat::appendInteger(m_outputBuffer.block(), uint64_t(x)); }
+	void printValue(int64_t x) { NumberFormat::appendInteger(m_outputBuffer.block(), x); }
+	void printValue(uint64_t x) { NumberFormat::appendInteger(m_outputBuffer.block(), x); }
 
 public:
 	Input<T> input{this, "", "Input value"};
 
 	Param<std::string> target{this, "target", "Output filename", "-"};
+	Param<std::string> flushPolicy{this, "flushPolicy", "Flush output per \"line\", every flushLines \"lines\", every flushBytes \"bytes\" or on \"finalize\" only", "line"};
+	Param<int64_t> flushLines{this, "flushLines", "Number of lines between flushes for flushPolicy \"lines\"", 10000};
+	Param<int64_t> flushBytes{this, "flushBytes", "Number of bytes between flushes for flushPolicy \"bytes\"", 1024 * 1024};
+	Param<int64_t> blockSize{this, "blockSize", "Size of output blocks in bytes (written without flush when full)", 1024 * 1024};
+	Param<bool> async{this, "async", "Write output blocks in a background thread", false};
 
 	Output<ssize_t> output{this, "", "Number of lines in output"};
 
@@ -73,18 +218,32 @@ template<typename T> void TextFilePrinter<T>::newReduction() {
 	} catch (std::runtime_error &e) {
 		throw runtime_error("Can't open \"%s\" for output in bric \"%s\": %s"_format(target.get(), absolutePath(), e.what()));
 	}
+	m_outputBuffer.open(
+		m_outputStream.stream(), BlockOutputBuffer::flushPolicy(flushPolicy),
+		size_t(flushLines.get()), size_t(flushBytes.get()), size_t(blockSize.get()), async
+	);
 }
 
 
 template<typename T> void TextFilePrinter<T>::processInput() {
 	using namespace std;
-	m_outputStream.stream() << input.get() << '\n' << flush;
-	if (! m_outputStream.stream()) throw runtime_error("Output to \"%s\" failed in bric \"%s\""_format(target.get(), absolutePath()));
+	try {
+		printValue(input.get());
+		m_outputBuffer.endLine();
+	} catch (std::runtime_error &e) {
+		throw runtime_error("Output to \"%s\" failed in bric \"%s\": %s"_format(target.get(), absolutePath(), e.what()));
+	}
 }
 
 
 template<typename T> void TextFilePrinter<T>::finalizeReduction() {
 	dbrx_log_trace("TextFilePrinter \"%s\", closing output \"%s\""_format(absolutePath(), target.get()));
+	try {
+		m_outputBuffer.close();
+	} catch (std::runtime_error &e) {
+		throw std::runtime_error("Output to \"%s\" failed in bric \"%s\": %s"_format(target.get(), absolutePath(), e.what()));
+	}
+	output = ssize_t(m_outputBuffer.nLines());
 	m_outputStream.close();
 }
 